@@ -48,6 +48,16 @@ void __coverage__(int line, int col) {
   fclose(f);
 }
 
+/* Probe of -block-coverage: locs holds count (line, col) pairs. */
+void __coverage_block__(const int *locs, int count) {
+  char logfile[STR_MAX_SIZE];
+  get_logfile(logfile, sizeof(logfile), ".cov");
+  FILE *f = fopen(logfile, "a");
+  for (int i = 0; i < count; ++i)
+    fprintf(f, "%d, %d\n", locs[2 * i], locs[2 * i + 1]);
+  fclose(f);
+}
+
 void __binop_op__(char c, int line, int col, int op1, int op2) {
   char logfile[STR_MAX_SIZE];
   get_logfile(logfile, sizeof(logfile), ".binops");
@@ -1,6 +1,13 @@
 #include "Instrument.h"
 #include "Utils.h"
 
+#include <map>
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+
 using namespace llvm;
 
 namespace instrument
@@ -9,9 +16,28 @@ namespace instrument
   const auto PASS_NAME = "DynamicAnalysisPass";
   const auto PASS_DESC = "Dynamic Analysis Pass";
   const auto COVERAGE_FUNCTION_NAME = "__coverage__";
+  const auto BLOCK_COVERAGE_FUNCTION_NAME = "__coverage_block__";
   const auto BINOP_OPERANDS_FUNCTION_NAME = "__binop_op__";
 
+  static cl::opt<bool> BlockCoverage(
+      "block-coverage",
+      cl::desc("Report the statements of each straight-line region with one "
+               "__coverage_block__ call instead of one __coverage__ call per "
+               "statement"));
+
+  /**
+   * A -block-coverage probe: the (line, col) pairs of a run of instructions
+   * that always execute together, reported by one call before InsertPt.
+   */
+  struct CoverageProbe
+  {
+    Instruction *InsertPt;
+    std::vector<int> Locs; // line, col, line, col, ...
+  };
+
   void instrumentCoverage(Module *M, Instruction &I, int Line, int Col);
+  void collectProbes(Function &F, std::vector<CoverageProbe> &Probes);
+  void instrumentProbe(Module *M, CoverageProbe &Probe);
   void instrumentBinOpOperands(Module *M, BinaryOperator *BinOp, int Line,
                                int Col);
 
@@ -31,9 +57,19 @@ namespace instrument
     M->getOrInsertFunction(COVERAGE_FUNCTION_NAME, VoidType, Int32Type,
                            Int32Type);
 
+    M->getOrInsertFunction(BLOCK_COVERAGE_FUNCTION_NAME, VoidType,
+                           Type::getInt32PtrTy(Context), Int32Type);
+
     M->getOrInsertFunction(BINOP_OPERANDS_FUNCTION_NAME, VoidType, Int8Type,
                            Int32Type, Int32Type, Int32Type, Int32Type);
 
+    // Regions are computed before any call is inserted.
+    std::vector<CoverageProbe> Probes;
+    if (BlockCoverage)
+    {
+      collectProbes(F, Probes);
+    }
+
     for (inst_iterator Iter = inst_begin(F), E = inst_end(F); Iter != E; ++Iter)
     {
       Instruction &Inst = (*Iter);
@@ -46,7 +82,10 @@ namespace instrument
 
       int Line = DebugLoc.getLine();
       int Col = DebugLoc.getCol();
-      instrumentCoverage(M, Inst, Line, Col);
+      if (!BlockCoverage)
+      {
+        instrumentCoverage(M, Inst, Line, Col);
+      }
 
       /**
        * TODO: Add code to check if the instruction is a BinaryOperator and if so,
@@ -59,6 +98,11 @@ namespace instrument
       }
     }
 
+    for (auto &Probe : Probes)
+    {
+      instrumentProbe(M, Probe);
+    }
+
     return true;
   }
 
@@ -75,6 +119,77 @@ namespace instrument
     CallInst::Create(CoverageFunction, Args, "", &I);
   }
 
+  /**
+   * Split F into probe regions. A region starts at a block entry and ends
+   * after the next call, which may not return, or after a division, which
+   * may trap. A block whose only predecessor has it as only successor
+   * continues the predecessor's open region instead of getting its own
+   * probe. Each region keeps one (line, col) pair per instruction, so the
+   * runtime reports exactly what per-statement probes would have.
+   */
+  void collectProbes(Function &F, std::vector<CoverageProbe> &Probes)
+  {
+    std::map<BasicBlock *, int> OpenAtEnd;
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *BB : RPOT)
+    {
+      int Open = -1;
+      BasicBlock *Pred = BB->getSinglePredecessor();
+      if (Pred && Pred != BB && Pred->getSingleSuccessor() == BB &&
+          OpenAtEnd.count(Pred))
+      {
+        Open = OpenAtEnd[Pred];
+      }
+
+      for (Instruction &Inst : *BB)
+      {
+        llvm::DebugLoc DebugLoc = Inst.getDebugLoc();
+        if (!DebugLoc || isa<PHINode>(Inst))
+        {
+          continue;
+        }
+        if (Open < 0)
+        {
+          Probes.push_back({&Inst, {}});
+          Open = Probes.size() - 1;
+        }
+        Probes[Open].Locs.push_back(DebugLoc.getLine());
+        Probes[Open].Locs.push_back(DebugLoc.getCol());
+
+        auto Opcode = Inst.getOpcode();
+        if (((isa<CallInst>(Inst) || isa<InvokeInst>(Inst)) &&
+             !isa<IntrinsicInst>(Inst)) ||
+            Opcode == Instruction::SDiv || Opcode == Instruction::UDiv ||
+            Opcode == Instruction::SRem || Opcode == Instruction::URem)
+        {
+          Open = -1;
+        }
+      }
+      if (Open >= 0)
+      {
+        OpenAtEnd[BB] = Open;
+      }
+    }
+  }
+
+  void instrumentProbe(Module *M, CoverageProbe &Probe)
+  {
+    auto &Context = M->getContext();
+    auto *Int32Type = Type::getInt32Ty(Context);
+
+    auto *Table = ConstantDataArray::get(Context, Probe.Locs);
+    auto *TableVar = new GlobalVariable(*M, Table->getType(), true,
+                                        GlobalValue::PrivateLinkage, Table,
+                                        "__probe_locs__");
+    auto *TablePtr =
+        ConstantExpr::getPointerCast(TableVar, Type::getInt32PtrTy(Context));
+    auto *Count = ConstantInt::get(Int32Type, Probe.Locs.size() / 2);
+
+    std::vector<Value *> Args = {TablePtr, Count};
+    auto *CoverageFunction = M->getFunction(BLOCK_COVERAGE_FUNCTION_NAME);
+    CallInst::Create(CoverageFunction, Args, "", Probe.InsertPt);
+  }
+
   void instrumentBinOpOperands(Module *M, BinaryOperator *BinOp, int Line,
                                int Col)
   {
@@ -0,0 +1,70 @@
+#ifndef BANDIT_H
+#define BANDIT_H
+
+#include <random>
+#include <vector>
+
+#include "Scheduler.h"
+
+/**
+ * Multi-armed bandit choosing the mutation functions of havoc stacks.
+ *
+ * Each arm (mutation function) accumulates the reward of the runs it took
+ * part in (new coverage, new crash buckets) and their exec time, split
+ * evenly among the mutations of the stack. Its value is reward per
+ * CPU-second, relative to the best arm, plus the UCB1 exploration bonus
+ * sqrt(2 ln N / n). Arms no run has been credited to yet count as the best
+ * arm tried once.
+ *
+ * Arms are sampled in proportion to their value, so a stack still mixes
+ * mutations, from an alias table rebuilt every REBUILD_PICKS picks: O(1)
+ * per pick and O(arms) per rebuild. Every rebuild also decays the totals,
+ * so budget moves away from mutations that stopped finding anything.
+ */
+class MutationBandit {
+public:
+  explicit MutationBandit(size_t Arms = 0) { reset(Arms); }
+
+  /**
+   * @brief Forget everything and start over with Arms arms.
+   */
+  void reset(size_t Arms);
+
+  /**
+   * @return size_t the arm to pull next, drawn with Rng.
+   */
+  size_t select(std::mt19937 &Rng);
+
+  /**
+   * @brief Credit Arm with one run that yielded Reward and took CostUs
+   * microseconds of its exec time.
+   */
+  void reward(size_t Arm, double Reward, double CostUs);
+
+  /**
+   * @return std::vector<double> the totals of every arm, for checkpoints.
+   */
+  std::vector<double> state() const;
+
+  /**
+   * @brief Restore totals returned by state(), if they are for as many
+   * arms as this bandit has.
+   */
+  void restore(const std::vector<double> &State);
+
+private:
+  struct Arm {
+    double Pulls = 0;
+    double Reward = 0;
+    double CostUs = 0;
+  };
+
+  void rebuild();
+
+  std::vector<Arm> Arms;
+  std::vector<double> Weights;
+  AliasTable Table;
+  int PicksSinceRebuild = 0;
+};
+
+#endif // BANDIT_H
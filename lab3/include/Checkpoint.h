@@ -0,0 +1,104 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Corpus.h"
+#include "Grammar.h"
+
+/**
+ * Periodic checkpoints of the campaign state, so a fuzzer run with
+ * --resume picks up where a killed one stopped without replaying its
+ * queue.
+ *
+ * A checkpoint lives in OutDir/queue:
+ *   id_NNNNNN           one file per queue entry, written once.
+ *   .state/entries      metadata of every entry, one line each:
+ *                       file exec_us path_hash depth times_picked
+ *                       deterministic_done cmplog_done distance
+ *   .state/coverage     the campaign's coverage bitmap (MAP_SIZE bytes).
+ *   .state/path_freq    "slot count" lines of the path frequency table.
+ *   .state/mutationsN   mutation scheduler state of worker N (see Bandit.h).
+ *   .state/progress     "elapsed_ms execs" of the campaign so far.
+ *   .state/trees/       derivation tree of every entry in grammar mode, in
+ *                       a file named like the entry (see encodeTree()).
+ *
+ * The state files are replaced via rename, so a fuzzer killed while
+ * checkpointing leaves the previous checkpoint intact. Entries found
+ * after it are lost.
+ */
+// Milliseconds between checkpoints.
+const long CHECKPOINT_INTERVAL_MS = 30 * 1000;
+
+/**
+ * How far a campaign got, so a resumed one continues its clock and exec
+ * count instead of starting over at zero.
+ */
+struct CampaignProgress {
+  long ElapsedMs = 0;
+  long Execs = 0;
+};
+
+class Checkpointer {
+public:
+  /**
+   * @brief Whether the next checkpoint is due. True for only one caller
+   * per CHECKPOINT_INTERVAL_MS, which should then call save().
+   */
+  bool due();
+
+  /**
+   * @brief Write the queue entries not saved yet, then the metadata of
+   * all of them, the coverage bitmap, the path frequencies and Progress.
+   */
+  void save(const std::string &OutDir, Corpus &Queue,
+            const CampaignProgress &Progress);
+
+  /**
+   * @brief Load the checkpoint in OutDir into Queue, the coverage bitmap,
+   * the path frequency table and Progress (zero if it was not saved).
+   *
+   * @param TreeGrammar grammar to decode the entries' derivation trees
+   * with, null outside grammar mode. Entries whose tree does not fit it
+   * (e.g. the grammar changed) are loaded without one.
+   * @return int number of queue entries loaded, -1 if there is no
+   * checkpoint.
+   */
+  int load(const std::string &OutDir, Corpus &Queue,
+           CampaignProgress &Progress,
+           const Grammar *TreeGrammar = nullptr);
+
+  /**
+   * @return int number of checkpoints saved so far; workers save their
+   * own state when it changes.
+   */
+  int epoch() const { return Epoch.load(std::memory_order_acquire); }
+
+private:
+  std::mutex Lock;
+  std::unordered_map<const QueueEntry *, std::string> Files;
+  int NextId = 0;
+  std::atomic<long> NextSaveMs{CHECKPOINT_INTERVAL_MS};
+  std::atomic<int> Epoch{0};
+  std::chrono::steady_clock::time_point Start =
+      std::chrono::steady_clock::now();
+};
+
+/**
+ * @brief Save the mutation scheduler state of worker WorkerId.
+ */
+void saveWorkerScores(const std::string &OutDir, int WorkerId,
+                      const std::vector<double> &Scores);
+
+/**
+ * @return std::vector<double> the mutation scheduler state saved for
+ * worker WorkerId, empty if there is none.
+ */
+std::vector<double> loadWorkerScores(const std::string &OutDir, int WorkerId);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,58 @@
+#ifndef CMPLOG_H
+#define CMPLOG_H
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "Runtime.h"
+
+/**
+ * Input-to-state comparison solving, as in Redqueen.
+ *
+ * A target built with -cmplog logs the operands of its integer comparisons
+ * (see struct cmp_map in Runtime.h). When an operand shows up verbatim in
+ * the input, as raw bytes in either byte order or as decimal text, patching
+ * it with the other operand likely flips the comparison. Each such patch
+ * costs one exec, instead of the many it takes random mutations to guess a
+ * multi-byte value.
+ *
+ * To tell real matches from coincidences, the input is first colorized:
+ * as many bytes as possible are randomized without changing its path. A
+ * match only counts if the colorized input also holds the colorized run's
+ * operand at the same offset.
+ */
+
+/**
+ * @brief Randomize as many bytes of Input as possible while keeping its
+ * path, trying the largest ranges first. Newlines and NULs are kept, and
+ * digits and letters stay digits and letters, so text parsing is not
+ * disturbed.
+ *
+ * @param Input input to colorize.
+ * @param PathHash path checksum of Input.
+ * @param Rng random number stream.
+ * @param PathOf runs an input and returns its path checksum.
+ * @return std::string the colorized input.
+ */
+std::string colorize(const std::string &Input, uint32_t PathHash,
+                     std::mt19937 &Rng,
+                     const std::function<uint32_t(std::string &)> &PathOf);
+
+/**
+ * @brief Run every input-to-state patch of Input through Run.
+ *
+ * @param Input input the comparisons were logged for.
+ * @param Cmps comparison log of Input.
+ * @param Colorized colorized version of Input.
+ * @param ColorCmps comparison log of Colorized.
+ * @param Run called with each patched input.
+ * @return size_t number of calls to Run.
+ */
+size_t solveComparisons(const std::string &Input, const cmp_map &Cmps,
+                        const std::string &Colorized,
+                        const cmp_map &ColorCmps,
+                        const std::function<void(std::string &)> &Run);
+
+#endif // CMPLOG_H
@@ -0,0 +1,82 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct DerivationNode;
+
+/**
+ * One input of the fuzzing queue and what is known about it.
+ *
+ * @param Input       the input itself.
+ * @param ExecUs      execution time in microseconds.
+ * @param PathHash    checksum of the classified coverage it produced.
+ * @param Depth       number of mutation steps from a seed.
+ * @param TimesPicked how often the scheduler has picked it.
+ * @param DeterministicDone whether the deterministic stage has claimed it.
+ * @param CmpLogDone  whether the comparison solving stage has claimed it.
+ * @param Tree        derivation tree of the input in grammar mode (see
+ *                    Grammar.h), null otherwise or for seeds.
+ * @param Distance    mean distance of its run to the division sites in
+ *                    directed mode, -1 if unknown or none was reachable.
+ */
+struct QueueEntry {
+  std::string Input;
+  long ExecUs = 0;
+  uint32_t PathHash = 0;
+  int Depth = 0;
+  std::atomic<int> TimesPicked{0};
+  std::atomic<bool> DeterministicDone{false};
+  std::atomic<bool> CmpLogDone{false};
+  std::shared_ptr<const DerivationNode> Tree;
+  double Distance = -1;
+};
+
+/**
+ * The fuzzing queue, shared by all fuzzing workers. Entries are never
+ * removed, so a pointer to an entry stays valid for the whole campaign.
+ *
+ * The queue is split into shards with their own locks. A worker only adds
+ * to its own shard but reads all of them, so an input found by one worker
+ * is available to every other worker right away while workers rarely wait
+ * on the same lock.
+ */
+class Corpus {
+public:
+  explicit Corpus(int NumShards = 1);
+
+  /**
+   * @brief Add Entry to Shard unless the shard already holds its input.
+   *
+   * @return bool true if Entry was added.
+   */
+  bool add(int Shard, std::shared_ptr<QueueEntry> Entry);
+
+  /**
+   * @brief Copy the current entries of all shards into Entries.
+   */
+  void snapshot(std::vector<std::shared_ptr<QueueEntry>> &Entries);
+
+  /**
+   * @return size_t number of entries over all shards.
+   */
+  size_t size() const { return Size.load(std::memory_order_relaxed); }
+
+private:
+  struct Shard {
+    std::mutex Lock;
+    std::vector<std::shared_ptr<QueueEntry>> Entries;
+    std::unordered_set<std::string> Seen;
+  };
+
+  std::vector<std::unique_ptr<Shard>> Shards;
+  std::atomic<size_t> Size{0};
+};
+
+#endif // CORPUS_H
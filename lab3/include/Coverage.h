@@ -0,0 +1,73 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Campaign-wide coverage bookkeeping on MAP_SIZE hit-count bitmaps.
+ *
+ * Raw hit counts are first folded into buckets (1, 2, 3, 4-7, 8-15, 16-31,
+ * 32-127, 128+), one bit per bucket, so a loop running a different number
+ * of times counts as new behaviour while jitter within a bucket does not.
+ * The bucketed trace is then checked against the bits seen over all runs
+ * of all workers, a 64-bit word at a time.
+ */
+
+/**
+ * @brief Fill Trace from the "line, col" records of a Target.cov file.
+ *
+ * @param CoverageData lines read from the coverage file.
+ * @param Trace MAP_SIZE bitmap to fill, expected to be zeroed.
+ */
+void traceFromCoverageData(std::vector<std::string> &CoverageData,
+                           unsigned char *Trace);
+
+/**
+ * @brief Replace every hit count in Trace by its bucket bit.
+ *
+ * @param Trace MAP_SIZE bitmap of one run.
+ */
+void classifyCounts(unsigned char *Trace);
+
+/**
+ * @brief Merge a classified Trace into the campaign's coverage.
+ *
+ * Safe to call from several workers at once.
+ *
+ * @param Trace classified MAP_SIZE bitmap of one run.
+ * @return int 2 if a map slot was reached for the first time, 1 if only a
+ * new hit-count bucket was seen, 0 otherwise.
+ */
+int hasNewBits(const unsigned char *Trace);
+
+/**
+ * @brief Checksum of a classified Trace, identifying the path it took.
+ */
+uint32_t hashTrace(const unsigned char *Trace);
+
+/**
+ * @brief Checksum of the set of map slots Trace reached, ignoring hit
+ * counts, so runs that loop a different number of times hash alike.
+ */
+uint32_t hashSlots(const unsigned char *Trace);
+
+/**
+ * @return int number of map slots reached so far.
+ */
+int countCoveredSlots();
+
+/**
+ * @brief Copy the campaign's coverage, as a MAP_SIZE bitmap of bucket bits,
+ * into Out.
+ */
+void copySeenBits(unsigned char *Out);
+
+/**
+ * @brief Merge a bitmap saved by copySeenBits() into the campaign's
+ * coverage.
+ */
+void mergeSeenBits(const unsigned char *In);
+
+#endif // COVERAGE_H
@@ -0,0 +1,84 @@
+#ifndef CRASHES_H
+#define CRASHES_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "Runtime.h"
+
+/**
+ * @brief Signature of a crash. It is the __sanitize__ site that fired if
+ * there was one. Otherwise it is how the target died plus a hash of the
+ * last statements it reported. Builds that keep no trail (-edge-coverage)
+ * hash the set of covered map slots instead.
+ *
+ * @param Status wait status of the run.
+ * @param Info crash site and trail of the run.
+ * @param Trace coverage bitmap of the run.
+ * @return std::string e.g. "sanitize-12-7" or "signal11-1f2e3d4c".
+ */
+std::string crashSignature(int Status, const crash_info &Info,
+                           const unsigned char *Trace);
+
+/**
+ * @brief Rebuild the crash_info of the last run of Target from the files
+ * the runtime writes without shared memory: Target.crash for the
+ * __sanitize__ site and Target.cov for the trail.
+ *
+ * @param Target name of target binary.
+ * @param Info filled with the crash site and trail.
+ */
+void crashInfoFromFiles(std::string &Target, crash_info &Info);
+
+/**
+ * Crashes bucketed by signature, shared by all fuzzing workers.
+ *
+ * Only the first input of each bucket is saved, to failure/inputN, and is
+ * replaced whenever a smaller one turns up. OutDir/crash_summary.txt lists
+ * every bucket with its crash count and saved input. It is rewritten when
+ * a bucket opens or changes input, and at most once a second otherwise.
+ */
+class CrashBuckets {
+public:
+  /**
+   * @brief Count a crash of Input with Signature.
+   *
+   * @return bool true if the crash opened a new bucket.
+   */
+  bool add(const std::string &Signature, const std::string &Input,
+           const std::string &OutDir);
+
+  /**
+   * @brief Restore the buckets listed in OutDir/crash_summary.txt, when
+   * resuming a campaign.
+   */
+  void load(const std::string &OutDir);
+
+  /**
+   * @return int number of buckets.
+   */
+  int unique();
+
+  /**
+   * @return long number of crashes over all buckets.
+   */
+  long total();
+
+private:
+  struct Bucket {
+    long Count = 0;
+    size_t Size = 0;
+    std::string Path;
+  };
+
+  void writeSummary(const std::string &OutDir);
+
+  std::mutex Lock;
+  std::map<std::string, Bucket> Buckets;
+  long Total = 0;
+  std::chrono::steady_clock::time_point LastSummary;
+};
+
+#endif // CRASHES_H
@@ -0,0 +1,41 @@
+#ifndef DETERMINISTIC_H
+#define DETERMINISTIC_H
+
+#include <functional>
+#include <string>
+
+/**
+ * Deterministic mutation stage, run once on each new queue entry.
+ *
+ * Walks the input with, in order:
+ *  - flips of 1, 2 and 4 consecutive bits at every bit offset,
+ *  - flips of 1, 2 and 4 consecutive bytes at every byte offset,
+ *  - adding and subtracting 1..ARITH_MAX to 8, 16 and 32-bit words in both
+ *    byte orders,
+ *  - overwriting 8, 16 and 32-bit words with interesting values (0, -1,
+ *    INT_MAX, powers of two and their neighbours),
+ *  - truncating or padding the input to boundary lengths.
+ *
+ * Each mutation is applied to Buf in place, handed to Run, and undone
+ * before the next one, so no copy of the input is made. Results that an
+ * earlier step already produced (e.g. arithmetic that is only a bit flip)
+ * are skipped. Only the first DETERMINISTIC_MAX_LEN bytes are walked.
+ */
+
+// Largest value added to or subtracted from a word.
+const int ARITH_MAX = 35;
+
+// Longest prefix of an input that the stage walks.
+const size_t DETERMINISTIC_MAX_LEN = 256;
+
+/**
+ * @brief Run every deterministic mutation of Buf through Run.
+ *
+ * @param Buf input to mutate, holds the original again on return.
+ * @param Run called with each mutated input.
+ * @return size_t number of calls to Run.
+ */
+size_t runDeterministicStage(std::string &Buf,
+                             const std::function<void(std::string &)> &Run);
+
+#endif // DETERMINISTIC_H
@@ -0,0 +1,33 @@
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <set>
+#include <string>
+
+using namespace llvm;
+
+namespace dictionary {
+
+/**
+ * Collects the constants a program compares its input against (icmp and
+ * switch operands, string literals given to strcmp/memcmp and friends,
+ * character constants) and writes them to a fuzzer dictionary.
+ *
+ * The module is left unchanged. Run it before -Instrument so that the
+ * comparisons inserted by -edge-coverage do not end up as tokens.
+ */
+struct Dictionary : public ModulePass {
+  static char ID;
+
+  Dictionary() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+
+private:
+  std::set<std::string> Tokens;
+
+  void addToken(StringRef Token);
+  void addInteger(const APInt &Value, bool IsChar);
+  void writeDictionary(Module &M);
+};
+} // namespace dictionary
@@ -0,0 +1,88 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <string>
+#include <sys/types.h>
+
+#include "Runtime.h"
+
+/**
+ * Handle to a fork server running inside an instrumented target.
+ *
+ * @param Pid       pid of the fork server process.
+ * @param ShmId     coverage bitmap exported to the target, -1 for none.
+ * @param CmpShmId  comparison log exported to the target, -1 for none.
+ * @param MemLimitMb address space limit of the target in MiB, 0 for none.
+ * @param CtlFd     pipe used to request a new run.
+ * @param StFd      pipe on which the fork server reports pids and statuses.
+ * @param InputFd   file that every child reads as its stdin.
+ * @param InputPath path of that file.
+ */
+struct ForkServer {
+  pid_t Pid = -1;
+  int ShmId = -1;
+  int CmpShmId = -1;
+  size_t MemLimitMb = 0;
+  int CtlFd = -1;
+  int StFd = -1;
+  int InputFd = -1;
+  std::string InputPath;
+};
+
+/**
+ * Returned instead of a wait status for a run that was killed for taking
+ * longer than its timeout.
+ */
+const int EXEC_TIMEOUT = -1;
+
+/**
+ * @brief Limit the address space of the calling process, to be called in
+ * a child before it executes the target.
+ *
+ * @param MemLimitMb limit in MiB, 0 for none.
+ */
+void setMemoryLimit(size_t MemLimitMb);
+
+/**
+ * @brief Start Target as a fork server and wait for its handshake.
+ *
+ * @param Server handle to initialize, with ShmId already set if needed.
+ * @param Target path to target binary.
+ * @param InputPath file to create for passing inputs to the target.
+ * @return int 0 on success, 1 if the target did not answer the handshake.
+ */
+int startForkServer(ForkServer &Server, std::string &Target,
+                    std::string &InputPath);
+
+/**
+ * @brief Run one forked child of the fork server with Input on its stdin.
+ *
+ * @param Server running fork server.
+ * @param Input input to provide to the target.
+ * @param TimeoutMs milliseconds after which the child is killed with
+ * SIGKILL, 0 for none.
+ * @return int wait status of the child, 0 if a persistent child finished the
+ * input and is waiting for the next one, EXEC_TIMEOUT if it was killed.
+ */
+int runForkServer(ForkServer &Server, std::string &Input, int TimeoutMs = 0);
+
+/**
+ * @brief Kill the fork server and release its resources.
+ *
+ * @param Server running fork server.
+ */
+void stopForkServer(ForkServer &Server);
+
+/**
+ * @brief Create a shared-memory segment for the target, by default the
+ * coverage bitmap followed by its crash_info. Targets find it through
+ * SHM_ENV_VAR (or CMPLOG_SHM_ENV_VAR for a comparison log) set to ShmId.
+ *
+ * @param ShmId set to the id of the new segment.
+ * @param Size size of the segment in bytes.
+ * @return unsigned char* the zeroed segment.
+ */
+unsigned char *setupSharedMemory(int &ShmId,
+                                 size_t Size = COVERAGE_SHM_SIZE);
+
+#endif // EXECUTOR_H
@@ -0,0 +1,133 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Grammar-based input generation, as in Nautilus.
+ *
+ * Inputs are derivation trees of a context-free grammar. They are mutated
+ * by regenerating a random subtree, by splicing in a subtree of the same
+ * nonterminal from another tree, or by repeating a recursive nonterminal.
+ * Every input the fuzzer runs is therefore syntactically valid.
+ *
+ * Grammar files are BNF-ish, one rule per line:
+ *
+ *   # comment
+ *   <start>  ::= <line> | <line> <start>
+ *   <line>   ::= "add " <number> "\n"
+ *            | "quit\n"
+ *   <number> ::= [0-9] | [1-9] <number>
+ *
+ * A rule is "<name> ::=" followed by alternatives separated by "|", and
+ * may continue on lines starting with "|". Alternatives are sequences of
+ * <nonterminals>, "terminals" (or 'terminals') with \n, \t, \\, \", \' and
+ * \xNN escapes, and [character classes] with ranges. The first rule's
+ * nonterminal is the start symbol.
+ */
+
+/**
+ * A node of a derivation tree: a nonterminal and the alternative it was
+ * expanded with, with one child per nonterminal of that alternative.
+ * Nodes are immutable and shared between trees; a mutation copies only the
+ * path from the root to the replaced subtree.
+ *
+ * @param Symbol   index of the nonterminal.
+ * @param Alt      index of the alternative.
+ * @param Children subtrees, in the order of the alternative.
+ * @param Size     number of nodes in this subtree.
+ */
+struct DerivationNode {
+  int Symbol = 0;
+  int Alt = 0;
+  std::vector<std::shared_ptr<const DerivationNode>> Children;
+  int Size = 1;
+};
+
+typedef std::shared_ptr<const DerivationNode> DerivationTree;
+
+/**
+ * @brief Encode Tree for a checkpoint as the preorder list of the
+ * alternatives it expands, from which Grammar::decode() rebuilds it.
+ */
+std::string encodeTree(const DerivationTree &Tree);
+
+class Grammar {
+public:
+  /**
+   * @brief Read the grammar at Path.
+   *
+   * @param Error set to a description of the first problem found.
+   * @return int 0 on success, 1 on error.
+   */
+  int load(const std::string &Path, std::string &Error);
+
+  /**
+   * @return DerivationTree a random derivation of the start symbol.
+   */
+  DerivationTree generate(std::mt19937 &Rng) const;
+
+  /**
+   * @brief Apply one random tree mutation to Tree.
+   *
+   * @param Tree tree to mutate, left untouched.
+   * @param Donor tree to splice subtrees from, may be null.
+   * @param Rng random number stream.
+   * @return DerivationTree the mutated tree.
+   */
+  DerivationTree mutate(const DerivationTree &Tree,
+                        const DerivationTree &Donor, std::mt19937 &Rng) const;
+
+  /**
+   * @brief Write the input Tree derives to Out.
+   *
+   * @return bool false if it is longer than MaxLen.
+   */
+  bool serialize(const DerivationTree &Tree, std::string &Out,
+                 size_t MaxLen) const;
+
+  /**
+   * @return DerivationTree the tree Text was encoded from by encodeTree(),
+   * null if Text does not fit this grammar.
+   */
+  DerivationTree decode(const std::string &Text) const;
+
+private:
+  struct Item {
+    bool Terminal;
+    int Symbol;       // nonterminal index when !Terminal
+    std::string Text; // terminal text when Terminal
+  };
+
+  struct Rule {
+    std::string Name;
+    std::vector<std::vector<Item>> Alts;
+    std::vector<int> AltDepth; // minimal derivation depth of each Alt
+    int MinDepth;
+  };
+
+  int symbolIndex(const std::string &Name);
+  int parseAlternatives(const std::string &Text, int RuleIdx,
+                        std::string &Error);
+  int computeDepths(std::string &Error);
+
+  DerivationTree generate(int Symbol, int Depth, int &NodeBudget,
+                          std::mt19937 &Rng) const;
+  DerivationTree regenerate(const DerivationTree &Tree,
+                            std::mt19937 &Rng) const;
+  DerivationTree splice(const DerivationTree &Tree, const DerivationTree &Donor,
+                        std::mt19937 &Rng) const;
+  DerivationTree recurse(const DerivationTree &Tree, std::mt19937 &Rng) const;
+  bool serialize(const DerivationNode &Node, std::string &Out,
+                 size_t MaxLen) const;
+  DerivationTree decode(int Symbol, const std::vector<int> &Alts,
+                        size_t &Next) const;
+
+  std::vector<Rule> Rules;
+  std::vector<bool> Defined;
+};
+
+#endif // GRAMMAR_H
@@ -15,6 +15,7 @@ struct Instrument : public FunctionPass {
 
   Instrument() : FunctionPass(ID) {}
 
+  bool doInitialization(Module &M) override;
   bool runOnFunction(Function &F) override;
 };
 } // namespace instrument
@@ -0,0 +1,27 @@
+#ifndef MINIMIZE_H
+#define MINIMIZE_H
+
+#include <string>
+
+/**
+ * @brief Copy to OutDir the smallest subset of the inputs in InDir that
+ * still reaches every coverage map slot reached by the whole of InDir.
+ *
+ * Every input is replayed through a fork server of Target, spread over Jobs
+ * threads. For each slot the input with the lowest size * exec time is
+ * preferred, starting from the slots covered by the fewest inputs. Inputs
+ * that time out are dropped.
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param InDir directory holding the corpus to minimize.
+ * @param OutDir directory to copy the kept inputs to.
+ * @param Jobs number of inputs to replay in parallel.
+ * @param TimeoutMs exec timeout of one input in milliseconds.
+ * @param MemLimitMb address space limit of the target in MiB, 0 for none.
+ * @return int exit status.
+ */
+int minimizeCorpus(std::string &Target, std::string &InDir,
+                   std::string &OutDir, int Jobs, int TimeoutMs,
+                   size_t MemLimitMb);
+
+#endif // MINIMIZE_H
@@ -0,0 +1,91 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Background writer for the inputs the fuzzer saves (success/, failure/,
+ * hangs/), so the exec loop never waits on the filesystem.
+ *
+ * Writes are handed over through a bounded queue; a writer thread drains it
+ * in batches. A producer only blocks when the queue is full, which bounds
+ * the memory held by pending inputs.
+ *
+ * In pack mode each output directory D becomes two append-only files
+ * instead of one file per input:
+ *   D.pack      records of [u32 name length][name][u32 data length][data],
+ *               little endian.
+ *   D.pack.idx  one "name offset length" line per record, offset being that
+ *               of the data in D.pack.
+ * A name written twice (a crash bucket getting a smaller input) has two
+ * records; the last one is current.
+ */
+class OutputWriter {
+public:
+  explicit OutputWriter(size_t Capacity = 1024) : Capacity(Capacity) {}
+  ~OutputWriter() { stop(); }
+
+  /**
+   * @brief Start the writer thread. Until then, and after stop(), writes
+   * are done synchronously.
+   *
+   * @param Pack write to pack files instead of one file per input.
+   */
+  void start(bool Pack);
+
+  /**
+   * @brief Write Data to the file at Path, or to the pack of Path's
+   * directory in pack mode.
+   */
+  void write(const std::string &Path, const std::string &Data);
+
+  /**
+   * @brief Write out everything queued so far and stop the writer thread.
+   */
+  void stop();
+
+private:
+  struct Record {
+    std::string Path;
+    std::string Data;
+  };
+
+  struct PackFiles {
+    FILE *Data = nullptr;
+    FILE *Index = nullptr;
+    uint64_t Offset = 0;
+  };
+
+  void run();
+  void writeRecord(const Record &R);
+  void writePacked(const Record &R);
+
+  std::mutex Lock;
+  std::condition_variable NotEmpty;
+  std::condition_variable NotFull;
+  std::deque<Record> Pending;
+  size_t Capacity;
+  bool Running = false;
+  bool Stopping = false;
+  bool Packed = false;
+  std::thread Thread;
+
+  // Open packs by directory; only touched by whoever holds the writes,
+  // the writer thread or a synchronous caller under WriteLock.
+  std::mutex WriteLock;
+  std::map<std::string, PackFiles> Packs;
+};
+
+/**
+ * The writer every saved input goes through.
+ */
+extern OutputWriter Output;
+
+#endif // OUTPUT_H
@@ -0,0 +1,154 @@
+/**
+ * Definitions shared between the fuzzer and the instrumentation runtime
+ * (lib/runtime.c). This header must stay valid C.
+ */
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+/**
+ * File descriptors the fork server inside the target talks on.
+ * FORKSRV_FD is read for run requests, FORKSRV_FD + 1 is written with
+ * the pid and then the wait status of every child.
+ */
+#define FORKSRV_FD 198
+
+/**
+ * Set in the environment of a target started as a fork server.
+ */
+#define FORKSRV_ENV_VAR "__FUZZER_FORKSRV"
+
+/**
+ * Set in the environment of a target whose __fuzzer_loop() should keep
+ * running inputs in the same process.
+ */
+#define PERSISTENT_ENV_VAR "__FUZZER_PERSISTENT"
+
+/**
+ * Size of the shared-memory coverage bitmap. Every byte is a saturating
+ * hit counter for the locations that hash to it.
+ */
+#define MAP_SIZE_POW2 16
+#define MAP_SIZE (1 << MAP_SIZE_POW2)
+
+/**
+ * Holds the SysV shared-memory id of the coverage bitmap. When unset the
+ * runtime falls back to appending to <target>.cov.
+ */
+#define SHM_ENV_VAR "__FUZZER_SHM_ID"
+
+/**
+ * Where a run crashed, kept in the shared memory right after the coverage
+ * bitmap. line and col are those of the __sanitize__ check that fired, or
+ * 0. trail holds the bitmap slots of the last CRASH_TRAIL_LEN statements
+ * reported, as a ring whose next write goes to trail_pos % CRASH_TRAIL_LEN.
+ */
+#define CRASH_TRAIL_LEN 16
+
+struct crash_info {
+  int line, col;
+  unsigned int trail_pos;
+  unsigned int trail[CRASH_TRAIL_LEN];
+};
+
+/**
+ * Distance of a run to the division sites, kept in the shared memory right
+ * after the crash_info. Code built with -directed adds the distance of
+ * every basic block it enters to sum and counts the block; blocks that
+ * cannot reach a division are not counted.
+ */
+struct distance_info {
+  unsigned long long sum;
+  unsigned long long count;
+};
+
+/**
+ * Size of the coverage shared memory: the bitmap, then a crash_info and a
+ * distance_info.
+ */
+#define COVERAGE_SHM_SIZE                                                      \
+  (MAP_SIZE + sizeof(struct crash_info) + sizeof(struct distance_info))
+
+/**
+ * Bitmap slot of the statement at (line, col).
+ */
+static inline unsigned coverage_index(int line, int col) {
+  unsigned h = (unsigned)line * 0x9E3779B1u ^ (unsigned)col * 0x85EBCA6Bu;
+  return (h ^ (h >> 16)) & (MAP_SIZE - 1);
+}
+
+/**
+ * Comparison log filled by code built with -cmplog. Each instrumented
+ * comparison owns one of CMP_MAP_SIZE slots and records the operands of
+ * its first CMP_LOG_LEN executions; hits keeps counting past that.
+ */
+#define CMP_MAP_SIZE 1024
+#define CMP_LOG_LEN 8
+
+struct cmp_operands {
+  unsigned long long a, b;
+};
+
+struct cmp_header {
+  unsigned int hits;
+  unsigned int size; /* operand width in bytes */
+};
+
+struct cmp_map {
+  struct cmp_header headers[CMP_MAP_SIZE];
+  struct cmp_operands log[CMP_MAP_SIZE][CMP_LOG_LEN];
+};
+
+/**
+ * Holds the SysV shared-memory id of the comparison log. When unset the
+ * runtime does not log comparisons.
+ */
+#define CMPLOG_SHM_ENV_VAR "__FUZZER_CMPLOG_SHM_ID"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Persistent-mode loop for targets, to be wrapped around the code that
+ * reads stdin and processes one input:
+ *
+ *   while (__fuzzer_loop(1000)) {
+ *     fgets(input, sizeof(input), stdin);
+ *     ...
+ *   }
+ *
+ * Under a persistent fuzzer (-p) every iteration handles a new input,
+ * with coverage reset in between, and the process is recycled after
+ * max_iters inputs. Otherwise the body runs exactly once.
+ */
+int __fuzzer_loop(unsigned int max_iters);
+
+/**
+ * Deferred fork server: the fork server normally starts before main(), so
+ * every run repeats the target's startup. A target whose startup does not
+ * depend on the input can instead call __fuzzer_init() once that is done,
+ * right before it first reads stdin, and define FUZZER_DEFERRED_INIT at file
+ * scope so the runtime waits for the call:
+ *
+ *   FUZZER_DEFERRED_INIT;
+ *
+ *   int main() {
+ *     load_tables();
+ *     __fuzzer_init();
+ *     fgets(input, sizeof(input), stdin);
+ *     ...
+ *   }
+ *
+ * Every run then starts from a fork taken at the call. Calls after the first
+ * do nothing, and a run that never reaches one starts the fork server when it
+ * exits. The Instrument pass's -defer-init inserts both automatically.
+ */
+void __fuzzer_init(void);
+
+#define FUZZER_DEFERRED_INIT int __fuzzer_deferred__ = 1
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RUNTIME_H
@@ -0,0 +1,120 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "Corpus.h"
+
+/**
+ * AFLFast-style power schedule over the fuzzing queue.
+ *
+ * Every entry gets a performance score from its exec time and length
+ * relative to the queue average and from its depth. Entries are picked in
+ * proportion to that score divided by how often their path has been
+ * exercised, and get an energy (number of mutations for this pick) that
+ * doubles with every pick but shrinks with the path's frequency. Cheap
+ * inputs on rare paths are therefore fuzzed the most.
+ *
+ * In directed mode the score is also scaled by how close an entry's run
+ * came to the division sites, under a simulated annealing schedule as in
+ * AFLGo: at first the distance does not matter, and as the temperature
+ * drops the closest entries get up to 32 times the average budget and the
+ * farthest 1/32 of it.
+ */
+
+/**
+ * Walker's alias table: O(n) to build, O(1) to sample.
+ */
+class AliasTable {
+public:
+  /**
+   * @brief Rebuild the table for picking index i with probability
+   * proportional to Weights[i].
+   */
+  void build(const std::vector<double> &Weights);
+
+  /**
+   * @return size_t a random index drawn with Rng.
+   */
+  size_t sample(std::mt19937 &Rng) const;
+
+  bool empty() const { return Prob.empty(); }
+
+private:
+  std::vector<double> Prob;
+  std::vector<uint32_t> Alias;
+};
+
+/**
+ * Queue-wide averages the scores are relative to.
+ */
+struct ScheduleStats {
+  double AvgExecUs = 1;
+  double AvgLen = 1;
+  double AvgPathFreq = 1;
+  double MinDistance = 0;
+  double MaxDistance = 0;
+};
+
+/**
+ * @brief Count one more execution that ended on the path PathHash.
+ */
+void recordPath(uint32_t PathHash);
+
+/**
+ * @return uint32_t number of executions recorded for PathHash.
+ */
+uint32_t pathFrequency(uint32_t PathHash);
+
+/**
+ * @brief Call Fn with every slot of the path frequency table that has
+ * executions recorded, and their count.
+ */
+void forEachPathFrequency(
+    const std::function<void(uint32_t Slot, uint32_t Count)> &Fn);
+
+/**
+ * @brief Restore a slot of the path frequency table reported by
+ * forEachPathFrequency().
+ */
+void setPathFrequency(uint32_t Slot, uint32_t Count);
+
+/**
+ * @brief Compute the averages of Entries.
+ */
+ScheduleStats computeStats(std::vector<std::shared_ptr<QueueEntry>> &Entries);
+
+/**
+ * @return double performance score of Entry, 100 for an average entry.
+ */
+double calculateScore(const QueueEntry &Entry, const ScheduleStats &Stats);
+
+/**
+ * @return double temperature of the directed schedule ElapsedS seconds
+ * into the campaign, from 1 down to 0.05 at ExploitS seconds and on
+ * towards 0.
+ */
+double annealingTemperature(double ElapsedS, double ExploitS);
+
+/**
+ * @return double factor to scale the score of Entry by in directed mode,
+ * between 1/32 and 32, at Temperature.
+ */
+double directedFactor(const QueueEntry &Entry, const ScheduleStats &Stats,
+                      double Temperature);
+
+/**
+ * @return double weight of Entry in the alias table.
+ */
+double selectionWeight(const QueueEntry &Entry, double Score);
+
+/**
+ * @return int number of mutations to run on Entry for this pick.
+ */
+int assignEnergy(const QueueEntry &Entry, double Score,
+                 const ScheduleStats &Stats);
+
+#endif // SCHEDULER_H
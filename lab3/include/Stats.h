@@ -0,0 +1,135 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Campaign telemetry, shared by all fuzzing workers.
+ *
+ * Once a second OutDir/fuzzer_stats is rewritten (via a temporary file and
+ * rename, so readers never see half of it) and a row is appended to
+ * OutDir/plot_data. Counting is a few relaxed atomic increments per exec;
+ * everything else happens on the tick, so the exec loop makes no extra
+ * syscalls.
+ *
+ * fuzzer_stats holds one "key : value" per line, plus one
+ * "mutator_<name> : runs finds crashes" line per mutation function.
+ * plot_data is CSV with a header row.
+ *
+ * OutDir/crash_times gets a CSV row as soon as a crash opens a new bucket,
+ * with the milliseconds and execs since the start, since a second is too
+ * coarse for time-to-crash on easy targets. Crash finds are rare enough
+ * to be written right away.
+ */
+
+/**
+ * Values of the campaign state owned by the fuzzer, sampled on each tick.
+ */
+struct StatsSample {
+  size_t CorpusSize = 0;
+  int CoveredSlots = 0;
+  int UniqueCrashes = 0;
+  long Crashes = 0;
+  int Hangs = 0;
+  int ExecTimeoutMs = 0;
+};
+
+class StatsReporter {
+public:
+  /**
+   * @brief Start the clock and write the plot_data header. Must be called
+   * before the workers start.
+   *
+   * @param OutDir directory to write fuzzer_stats and plot_data to.
+   * @param MutatorNames names of the mutation functions, by index.
+   * @param Append keep the rows of a resumed campaign in plot_data.
+   */
+  void start(const std::string &OutDir, std::vector<std::string> MutatorNames,
+             bool Append = false);
+
+  /**
+   * @brief Continue a resumed campaign's clock and exec count from
+   * ElapsedMs and Execs. Must be called right after start().
+   */
+  void resume(long ElapsedMs, long Execs);
+
+  /**
+   * @brief Count one run of the target.
+   */
+  void countExec() { Execs.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   * @brief Credit mutation Index with a run and what the run yielded.
+   */
+  void countMutation(int Index, bool NewCoverage, bool Crashed);
+
+  /**
+   * @brief Note that a new queue entry, crash bucket or hang was found now.
+   */
+  void countPathFind() { LastPath = elapsedMs(); }
+  void countHangFind() { LastHang = elapsedMs(); }
+
+  /**
+   * @brief Note that a crash opened bucket number UniqueCrashes now, and
+   * log it to crash_times.
+   */
+  void countCrashFind(int UniqueCrashes);
+
+  /**
+   * @return long number of execs so far, including those before a resume.
+   */
+  long execs() const { return Execs.load(std::memory_order_relaxed); }
+
+  /**
+   * @return long milliseconds since start(), plus those before a resume.
+   */
+  long elapsedMs() const;
+
+  /**
+   * @brief Whether the next tick is due. True for only one caller per
+   * second, which should then call write().
+   */
+  bool due();
+
+  /**
+   * @brief Rewrite fuzzer_stats, append to plot_data and print a status
+   * line to stderr.
+   *
+   * @param Final whether this is the last write of the campaign. If less
+   * than a tick has passed since the previous write, the final one keeps
+   * that write's rate, since a few milliseconds of execs say nothing, and
+   * appends no plot_data row.
+   */
+  void write(const StatsSample &Sample, bool Final = false);
+
+private:
+  struct MutatorCounts {
+    std::atomic<long> Runs{0};
+    std::atomic<long> Finds{0};
+    std::atomic<long> Crashes{0};
+  };
+
+  std::vector<std::string> Names;
+  std::unique_ptr<MutatorCounts[]> Mutators;
+  std::string OutDir;
+  std::chrono::steady_clock::time_point Start;
+  time_t StartTime = 0;
+  long ResumedMs = 0;
+  std::atomic<long> Execs{0};
+  std::atomic<long> NextTickMs{0};
+  std::atomic<long> LastPath{-1};
+  std::atomic<long> LastCrash{-1};
+  std::atomic<long> LastHang{-1};
+  std::mutex WriteLock;
+  std::mutex CrashLock;
+  long LastTickExecs = 0;
+  long LastTickMs = 0;
+  double LastTickRate = -1;
+};
+
+#endif // STATS_H
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
@@ -8,8 +9,9 @@
 #include <string>
 #include <sys/stat.h>
 
-extern int successCount;
-extern int failureCount;
+extern std::atomic<int> successCount;
+extern std::atomic<int> failureCount;
+extern std::atomic<int> hangCount;
 
 /**
  * @brief Initialize the Output Directory for fuzzer.
@@ -18,6 +20,14 @@ extern int failureCount;
  */
 void initialize(std::string &OutDir);
 
+/**
+ * @brief Continue the numbering of success/, failure/ and hangs/ after the
+ * inputs already in OutDir, when resuming a campaign.
+ *
+ * @param OutDir Path to Output Directory.
+ */
+void resumeCounts(std::string &OutDir);
+
 /**
  * @brief Read the file at Path into a string.
  *
@@ -36,6 +46,17 @@ std::string readOneFile(std::string &Path);
 int readSeedInputs(std::vector<std::string> &SeedInputs,
                    std::string &SeedInputDir);
 
+/**
+ * @brief Read a dictionary in the AFL format: one "token" per line, with
+ * \\, \" and \xNN escapes and an optional name= prefix. Blank lines and
+ * lines starting with # are skipped.
+ *
+ * @param Tokens Vector to store the tokens.
+ * @param Path Path to the dictionary file.
+ * @return int exit status.
+ */
+int readDictionary(std::vector<std::string> &Tokens, std::string &Path);
+
 /**
  * @brief Read the coverage file generated by running Target
  *
@@ -61,6 +82,14 @@ void storeSeed(std::string &OutDir, int randomSeed);
  */
 void storePassingInput(std::string &Input, std::string &OutDir);
 
+/**
+ * @brief Store an input, known to time out.
+ *
+ * @param Input Input string.
+ * @param OutDir Path to output directory.
+ */
+void storeHangingInput(std::string &Input, std::string &OutDir);
+
 /**
  * @brief Store an input, know to cause a crash.
  *
@@ -74,6 +103,10 @@ void storeCrashingInput(std::string &Input, std::string &OutDir);
  *
  * @param Target path to target binary.
  * @param Input input to provide to the target.
- * @return int return code on running target.
+ * @param TimeoutMs milliseconds after which the target is killed with
+ * SIGKILL, 0 for none.
+ * @param MemLimitMb address space limit of the target in MiB, 0 for none.
+ * @return int wait status of the target, EXEC_TIMEOUT if it was killed.
  */
-int runTarget(std::string &Target, std::string &Input);
\ No newline at end of file
+int runTarget(std::string &Target, std::string &Input, int TimeoutMs = 0,
+              size_t MemLimitMb = 0);
\ No newline at end of file
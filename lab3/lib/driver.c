@@ -0,0 +1,62 @@
+/*
+ * Entry point for targets written as a libFuzzer-style harness:
+ *
+ *   int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+ *
+ * and optionally
+ *
+ *   int LLVMFuzzerInitialize(int *argc, char ***argv);
+ *
+ * Link the instrumented harness with -lfuzzer_driver -lruntime. Each input
+ * is read from stdin and handed to the harness, many inputs per process
+ * when the fuzzer runs in persistent mode (-p). The fork server starts after
+ * LLVMFuzzerInitialize, so runs do not repeat it.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Runtime.h"
+
+/* Number of inputs one process handles before it is recycled. */
+#define MAX_ITERATIONS 10000
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+int LLVMFuzzerInitialize(int *argc, char ***argv) __attribute__((weak));
+
+FUZZER_DEFERRED_INIT;
+
+static size_t read_input(uint8_t **buf, size_t *cap) {
+  size_t len = 0;
+  ssize_t n;
+  while (1) {
+    if (len == *cap) {
+      *cap = *cap ? *cap * 2 : 4096;
+      *buf = realloc(*buf, *cap);
+      if (!*buf) {
+        fprintf(stderr, "Error: Out of memory reading input\n");
+        exit(1);
+      }
+    }
+    n = read(0, *buf + len, *cap - len);
+    if (n <= 0)
+      break;
+    len += n;
+  }
+  return len;
+}
+
+int main(int argc, char **argv) {
+  uint8_t *buf = NULL;
+  size_t cap = 0;
+  if (LLVMFuzzerInitialize)
+    LLVMFuzzerInitialize(&argc, &argv);
+  __fuzzer_init();
+  while (__fuzzer_loop(MAX_ITERATIONS)) {
+    size_t len = read_input(&buf, &cap);
+    LLVMFuzzerTestOneInput(buf, len);
+  }
+  free(buf);
+  return 0;
+}
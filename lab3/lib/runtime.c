@@ -1,9 +1,47 @@
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/shm.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <sys/wait.h>
 
-const int STR_MAX_SIZE = 1024;
+#include "Runtime.h"
+
+#define STR_MAX_SIZE 1024
+
+/* Set when coverage goes to the fuzzer's bitmap instead of <target>.cov. */
+static int __coverage_shm__ = 0;
+
+/*
+ * Coverage bitmap, also updated directly by code built with -edge-coverage.
+ * Points to a private dummy map unless the fuzzer shares one with us.
+ */
+static unsigned char __coverage_dummy_map__[MAP_SIZE];
+unsigned char *__coverage_map__ = __coverage_dummy_map__;
+
+/* Id of the last basic block executed, shifted, for -edge-coverage. */
+unsigned int __prev_loc__ = 0;
+
+/* Crash site and trail, shared with the fuzzer along with the bitmap. */
+static struct crash_info __crash_dummy_info__;
+static struct crash_info *__crash_info__ = &__crash_dummy_info__;
+
+/* Distance to the division sites, shared with the fuzzer as well. */
+static struct distance_info __distance_dummy_info__;
+static struct distance_info *__distance_info__ = &__distance_dummy_info__;
+
+/*
+ * Defined (to nonzero) by targets that call __fuzzer_init() themselves, see
+ * FUZZER_DEFERRED_INIT. Weak so that other targets link without it.
+ */
+extern int __fuzzer_deferred__ __attribute__((weak));
+
+/* <target>.cov and <target>.crash, resolved once at startup. */
+static char __cov_logfile__[STR_MAX_SIZE];
+static char __crash_logfile__[STR_MAX_SIZE];
 
 void get_logfile(char *buf, const int buf_size, const char *ext) {
   char exe[STR_MAX_SIZE];
@@ -26,14 +64,201 @@ void get_logfile(char *buf, const int buf_size, const char *ext) {
 void __sanitize__(int divisor, int line, int col) {
   if (divisor == 0) {
     printf("Divide-by-zero detected at line %d and col %d\n", line, col);
+    if (__coverage_shm__) {
+      __crash_info__->line = line;
+      __crash_info__->col = col;
+    } else {
+      FILE *f = fopen(__crash_logfile__, "w");
+      if (f) {
+        fprintf(f, "%d, %d\n", line, col);
+        fclose(f);
+      }
+    }
     exit(1);
   }
 }
 
+static void __bump__(int line, int col) {
+  unsigned slot = coverage_index(line, col);
+  unsigned char *counter = &__coverage_map__[slot];
+  if (*counter != 255)
+    ++*counter;
+  __crash_info__->trail[__crash_info__->trail_pos++ % CRASH_TRAIL_LEN] = slot;
+}
+
 void __coverage__(int line, int col) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cov");
-  FILE *f = fopen(logfile, "a");
+  if (__coverage_shm__) {
+    __bump__(line, col);
+    return;
+  }
+
+  FILE *f = fopen(__cov_logfile__, "a");
   fprintf(f, "%d, %d\n", line, col);
   fclose(f);
 }
+
+/* Probe of -block-coverage: locs holds count (line, col) pairs. */
+void __coverage_block__(const int *locs, int count) {
+  if (__coverage_shm__) {
+    for (int i = 0; i < count; ++i)
+      __bump__(locs[2 * i], locs[2 * i + 1]);
+    return;
+  }
+
+  FILE *f = fopen(__cov_logfile__, "a");
+  for (int i = 0; i < count; ++i)
+    fprintf(f, "%d, %d\n", locs[2 * i], locs[2 * i + 1]);
+  fclose(f);
+}
+
+/* Probe of -directed: a basic block distance away from a division. */
+void __distance__(unsigned int distance) {
+  __distance_info__->sum += distance;
+  ++__distance_info__->count;
+}
+
+/* Comparison log, only set when the fuzzer asked for a -cmplog run. */
+static struct cmp_map *__cmplog_map__ = NULL;
+
+/* Probe of -cmplog: the operands of comparison id, size bytes wide. */
+void __cmplog__(unsigned long long a, unsigned long long b, unsigned int size,
+                unsigned int id) {
+  if (!__cmplog_map__)
+    return;
+  struct cmp_header *header = &__cmplog_map__->headers[id];
+  unsigned int hit = header->hits++;
+  header->size = size;
+  if (hit < CMP_LOG_LEN) {
+    __cmplog_map__->log[id][hit].a = a;
+    __cmplog_map__->log[id][hit].b = b;
+  }
+}
+
+static void __map_shm__(void) {
+  const char *id = getenv(SHM_ENV_VAR);
+  if (!id)
+    return;
+  void *map = shmat(atoi(id), NULL, 0);
+  if (map == (void *)-1) {
+    fprintf(stderr, "Error: Cannot attach coverage map %s\n", id);
+    exit(1);
+  }
+  __coverage_map__ = map;
+  __crash_info__ = (struct crash_info *)(__coverage_map__ + MAP_SIZE);
+  __distance_info__ = (struct distance_info *)(__crash_info__ + 1);
+  __coverage_shm__ = 1;
+}
+
+static void __map_cmplog_shm__(void) {
+  const char *id = getenv(CMPLOG_SHM_ENV_VAR);
+  if (!id)
+    return;
+  void *map = shmat(atoi(id), NULL, 0);
+  if (map == (void *)-1) {
+    fprintf(stderr, "Error: Cannot attach comparison log %s\n", id);
+    exit(1);
+  }
+  __cmplog_map__ = map;
+}
+
+/*
+ * Fork server: when started by the fuzzer, the target stops here before
+ * main(), or in __fuzzer_init() for a deferred target, and forks a fresh
+ * child for every run request instead of being re-executed from scratch.
+ * Only the child ever returns from this function.
+ *
+ * A persistent child stops itself after each input instead of exiting;
+ * it is then resumed for the next request rather than forking again.
+ */
+static void __forkserver__(void) {
+  int msg = 0;
+  int child_stopped = 0;
+  pid_t child = -1;
+  if (!getenv(FORKSRV_ENV_VAR))
+    return;
+  /* Not attached to a fuzzer after all: run as a normal program. */
+  if (write(FORKSRV_FD + 1, &msg, 4) != 4)
+    return;
+
+  while (1) {
+    int status;
+    if (read(FORKSRV_FD, &msg, 4) != 4)
+      _exit(0);
+    if (child_stopped) {
+      kill(child, SIGCONT);
+      child_stopped = 0;
+    } else {
+      child = fork();
+      if (child < 0)
+        _exit(1);
+      if (child == 0) {
+        close(FORKSRV_FD);
+        close(FORKSRV_FD + 1);
+        return;
+      }
+    }
+    if (write(FORKSRV_FD + 1, &child, 4) != 4)
+      _exit(1);
+    if (waitpid(child, &status, WUNTRACED) < 0)
+      _exit(1);
+    child_stopped = WIFSTOPPED(status);
+    if (write(FORKSRV_FD + 1, &status, 4) != 4)
+      _exit(1);
+  }
+}
+
+void __fuzzer_init(void) {
+  static int started = 0;
+  if (started)
+    return;
+  started = 1;
+  __forkserver__();
+}
+
+int __fuzzer_loop(unsigned int max_iters) {
+  static int first_pass = 1;
+  static unsigned int remaining = 0;
+
+  if (first_pass) {
+    first_pass = 0;
+    if (!getenv(PERSISTENT_ENV_VAR))
+      max_iters = 1;
+    remaining = max_iters;
+    /* Startup code only runs once, keep it out of the first input's map. */
+    if (max_iters > 1) {
+      memset(__coverage_map__, 0, MAP_SIZE);
+      memset(__crash_info__, 0, sizeof(*__crash_info__));
+      memset(__distance_info__, 0, sizeof(*__distance_info__));
+    }
+    __prev_loc__ = 0;
+    return 1;
+  }
+
+  if (remaining <= 1)
+    return 0;
+  --remaining;
+
+  /* Tell the fork server this input is done, wait for the next one. */
+  raise(SIGSTOP);
+  /* The fuzzer rewound the input file; drop what stdio still buffers. */
+  __fpurge(stdin);
+  clearerr(stdin);
+  lseek(0, 0, SEEK_SET);
+  __prev_loc__ = 0;
+  return 1;
+}
+
+__attribute__((constructor)) static void __runtime_init__(void) {
+  __map_shm__();
+  __map_cmplog_shm__();
+  if (!__coverage_shm__) {
+    get_logfile(__cov_logfile__, sizeof(__cov_logfile__), ".cov");
+    get_logfile(__crash_logfile__, sizeof(__crash_logfile__), ".crash");
+  }
+  if (&__fuzzer_deferred__ && __fuzzer_deferred__) {
+    /* A run that ends before reaching __fuzzer_init() still needs one. */
+    atexit(__fuzzer_init);
+    return;
+  }
+  __fuzzer_init();
+}
@@ -0,0 +1,86 @@
+#include "Bandit.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Picks between rebuilds of the alias table.
+static const int REBUILD_PICKS = 256;
+
+// Factor the totals are multiplied with on every rebuild.
+static const double DECAY = 0.95;
+
+void MutationBandit::reset(size_t NumArms) {
+  Arms.assign(NumArms, Arm());
+  rebuild();
+}
+
+size_t MutationBandit::select(std::mt19937 &Rng) {
+  if (++PicksSinceRebuild >= REBUILD_PICKS)
+    rebuild();
+  return Table.sample(Rng);
+}
+
+void MutationBandit::reward(size_t Index, double Reward, double CostUs) {
+  Arm &A = Arms[Index];
+  A.Pulls += 1;
+  A.Reward += Reward;
+  A.CostUs += CostUs;
+}
+
+void MutationBandit::rebuild() {
+  PicksSinceRebuild = 0;
+  if (Arms.empty())
+    return;
+
+  // Reward per CPU-second of every arm, and of the best one.
+  std::vector<double> Rates(Arms.size(), 0);
+  double TotalPulls = 0, BestRate = 0;
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    const Arm &A = Arms[i];
+    TotalPulls += A.Pulls;
+    if (A.CostUs > 0)
+      Rates[i] = A.Reward / (A.CostUs / 1e6);
+    BestRate = std::max(BestRate, Rates[i]);
+  }
+
+  double LogPulls = std::log(std::max(TotalPulls, 1.0));
+  Weights.resize(Arms.size());
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    const Arm &A = Arms[i];
+    double Pulls = A.Pulls;
+    double Mean = BestRate > 0 ? Rates[i] / BestRate : 0;
+    if (Pulls < 1) {
+      Pulls = 1;
+      Mean = 1;
+    }
+    Weights[i] = Mean + std::sqrt(2 * LogPulls / Pulls);
+  }
+  Table.build(Weights);
+
+  for (Arm &A : Arms) {
+    A.Pulls *= DECAY;
+    A.Reward *= DECAY;
+    A.CostUs *= DECAY;
+  }
+}
+
+std::vector<double> MutationBandit::state() const {
+  std::vector<double> State;
+  for (const Arm &A : Arms) {
+    State.push_back(A.Pulls);
+    State.push_back(A.Reward);
+    State.push_back(A.CostUs);
+  }
+  return State;
+}
+
+void MutationBandit::restore(const std::vector<double> &State) {
+  if (State.size() != 3 * Arms.size())
+    return;
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    Arms[i].Pulls = State[3 * i];
+    Arms[i].Reward = State[3 * i + 1];
+    Arms[i].CostUs = State[3 * i + 2];
+  }
+  rebuild();
+}
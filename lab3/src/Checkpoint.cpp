@@ -0,0 +1,184 @@
+#include "Checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "Coverage.h"
+#include "Runtime.h"
+#include "Scheduler.h"
+#include "Utils.h"
+
+
+/**
+ * @brief Replace the file at Path with Data, through a temporary file so
+ * that it is never seen half written.
+ */
+static bool writeAtomically(const std::string &Path, const std::string &Data) {
+  std::string TmpPath = Path + ".tmp";
+  {
+    std::ofstream OutFile(TmpPath, std::ios::binary | std::ios::trunc);
+    if (!(OutFile << Data))
+      return false;
+  }
+  return rename(TmpPath.c_str(), Path.c_str()) == 0;
+}
+
+static std::string stateDir(const std::string &OutDir) {
+  return OutDir + "/queue/.state";
+}
+
+bool Checkpointer::due() {
+  long Now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - Start)
+                 .count();
+  long Next = NextSaveMs.load(std::memory_order_relaxed);
+  return Now >= Next &&
+         NextSaveMs.compare_exchange_strong(Next,
+                                            Now + CHECKPOINT_INTERVAL_MS);
+}
+
+void Checkpointer::save(const std::string &OutDir, Corpus &Queue,
+                        const CampaignProgress &Progress) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::string QueueDir = OutDir + "/queue";
+  mkdir(QueueDir.c_str(), 0755);
+  mkdir(stateDir(OutDir).c_str(), 0755);
+  mkdir((stateDir(OutDir) + "/trees").c_str(), 0755);
+
+  std::vector<std::shared_ptr<QueueEntry>> Entries;
+  Queue.snapshot(Entries);
+
+  std::string Metadata =
+      "# file exec_us path_hash depth times_picked deterministic_done "
+      "cmplog_done distance\n";
+  char Line[128];
+  for (auto &Entry : Entries) {
+    auto It = Files.find(Entry.get());
+    if (It == Files.end()) {
+      snprintf(Line, sizeof(Line), "id_%06d", NextId++);
+      std::ofstream OutFile(QueueDir + "/" + Line, std::ios::binary);
+      OutFile << Entry->Input;
+      if (Entry->Tree) {
+        std::ofstream TreeFile(stateDir(OutDir) + "/trees/" + Line);
+        TreeFile << encodeTree(Entry->Tree) << "\n";
+      }
+      It = Files.emplace(Entry.get(), Line).first;
+    }
+    snprintf(Line, sizeof(Line), "%s %ld %u %d %d %d %d %g\n",
+             It->second.c_str(), Entry->ExecUs, Entry->PathHash, Entry->Depth,
+             Entry->TimesPicked.load(), (int)Entry->DeterministicDone.load(),
+             (int)Entry->CmpLogDone.load(), Entry->Distance);
+    Metadata += Line;
+  }
+
+  std::string Coverage(MAP_SIZE, '\0');
+  copySeenBits((unsigned char *)&Coverage[0]);
+
+  std::string Paths;
+  forEachPathFrequency([&](uint32_t Slot, uint32_t Count) {
+    snprintf(Line, sizeof(Line), "%u %u\n", Slot, Count);
+    Paths += Line;
+  });
+
+  snprintf(Line, sizeof(Line), "%ld %ld\n", Progress.ElapsedMs,
+           Progress.Execs);
+  std::string Totals = Line;
+
+  std::string Dir = stateDir(OutDir);
+  if (!writeAtomically(Dir + "/coverage", Coverage) ||
+      !writeAtomically(Dir + "/path_freq", Paths) ||
+      !writeAtomically(Dir + "/progress", Totals) ||
+      !writeAtomically(Dir + "/entries", Metadata)) {
+    fprintf(stderr, "Cannot write checkpoint to %s\n", Dir.c_str());
+    return;
+  }
+  Epoch.fetch_add(1, std::memory_order_release);
+}
+
+int Checkpointer::load(const std::string &OutDir, Corpus &Queue,
+                       CampaignProgress &Progress,
+                       const Grammar *TreeGrammar) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::string Dir = stateDir(OutDir);
+  std::ifstream EntriesFile(Dir + "/entries");
+  if (!EntriesFile)
+    return -1;
+
+  std::string CoveragePath = Dir + "/coverage";
+  std::string Coverage = readOneFile(CoveragePath);
+  if (Coverage.size() == MAP_SIZE)
+    mergeSeenBits((const unsigned char *)Coverage.data());
+
+  std::ifstream PathsFile(Dir + "/path_freq");
+  uint32_t Slot, Count;
+  while (PathsFile >> Slot >> Count)
+    setPathFrequency(Slot, Count);
+
+  Progress = CampaignProgress();
+  std::ifstream ProgressFile(Dir + "/progress");
+  ProgressFile >> Progress.ElapsedMs >> Progress.Execs;
+
+  int Loaded = 0;
+  std::string Line;
+  while (std::getline(EntriesFile, Line)) {
+    char File[64];
+    auto Entry = std::make_shared<QueueEntry>();
+    int Picked, DeterministicDone, CmpLogDone;
+    // Checkpoints from before directed mode have no distance.
+    if (Line.empty() || Line[0] == '#' ||
+        sscanf(Line.c_str(), "%63s %ld %u %d %d %d %d %lf", File,
+               &Entry->ExecUs, &Entry->PathHash, &Entry->Depth, &Picked,
+               &DeterministicDone, &CmpLogDone, &Entry->Distance) < 7)
+      continue;
+    std::string Path = OutDir + "/queue/" + File;
+    std::ifstream InFile(Path, std::ios::binary);
+    if (!InFile)
+      continue;
+    Entry->Input.assign(std::istreambuf_iterator<char>(InFile),
+                        std::istreambuf_iterator<char>());
+    if (TreeGrammar) {
+      std::string TreePath = Dir + "/trees/" + File;
+      DerivationTree Tree = TreeGrammar->decode(readOneFile(TreePath));
+      std::string Derived;
+      if (Tree && TreeGrammar->serialize(Tree, Derived, Entry->Input.size()) &&
+          Derived == Entry->Input)
+        Entry->Tree = Tree;
+    }
+    Entry->TimesPicked = Picked;
+    Entry->DeterministicDone = DeterministicDone;
+    Entry->CmpLogDone = CmpLogDone;
+    int Id;
+    if (sscanf(File, "id_%d", &Id) == 1)
+      NextId = std::max(NextId, Id + 1);
+    const QueueEntry *Raw = Entry.get();
+    if (Queue.add(Loaded, std::move(Entry))) {
+      Files.emplace(Raw, File);
+      ++Loaded;
+    }
+  }
+  return Loaded;
+}
+
+void saveWorkerScores(const std::string &OutDir, int WorkerId,
+                      const std::vector<double> &Scores) {
+  std::string Data;
+  char Line[64];
+  for (double Score : Scores) {
+    snprintf(Line, sizeof(Line), "%.17g\n", Score);
+    Data += Line;
+  }
+  writeAtomically(stateDir(OutDir) + "/mutations" + std::to_string(WorkerId),
+                  Data);
+}
+
+std::vector<double> loadWorkerScores(const std::string &OutDir, int WorkerId) {
+  std::ifstream InFile(stateDir(OutDir) + "/mutations" +
+                       std::to_string(WorkerId));
+  std::vector<double> Saved;
+  double Score;
+  while (InFile >> Score)
+    Saved.push_back(Score);
+  return Saved;
+}
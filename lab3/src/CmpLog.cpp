@@ -0,0 +1,201 @@
+#include "CmpLog.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Execs colorize() may spend looking for bytes that can be randomized.
+static const int MAX_COLORIZE_EXECS = 64;
+
+// Patched inputs solveComparisons() tries per input at most.
+static const size_t MAX_CMPLOG_CANDIDATES = 4096;
+
+/**
+ * @brief A random byte of the same kind as C that differs from it.
+ */
+static char randomLike(char C, std::mt19937 &Rng) {
+  if (C == '\n' || C == '\0')
+    return C;
+  char R;
+  do {
+    if (C >= '0' && C <= '9')
+      R = '0' + Rng() % 10;
+    else if (C >= 'a' && C <= 'z')
+      R = 'a' + Rng() % 26;
+    else if (C >= 'A' && C <= 'Z')
+      R = 'A' + Rng() % 26;
+    else if (C >= 32 && C <= 126)
+      R = 32 + Rng() % 95;
+    else
+      R = 128 + Rng() % 128;
+  } while (R == C);
+  return R;
+}
+
+std::string colorize(const std::string &Input, uint32_t PathHash,
+                     std::mt19937 &Rng,
+                     const std::function<uint32_t(std::string &)> &PathOf) {
+  std::string Colorized = Input;
+  std::string Trial;
+  std::vector<std::pair<size_t, size_t>> Ranges; // [begin, end)
+  if (!Input.empty())
+    Ranges.push_back({0, Input.size()});
+
+  for (int Execs = 0; Execs < MAX_COLORIZE_EXECS && !Ranges.empty();
+       ++Execs) {
+    auto Largest = std::max_element(
+        Ranges.begin(), Ranges.end(),
+        [](const std::pair<size_t, size_t> &A,
+           const std::pair<size_t, size_t> &B) {
+          return A.second - A.first < B.second - B.first;
+        });
+    auto Range = *Largest;
+    Ranges.erase(Largest);
+
+    Trial = Colorized;
+    for (size_t i = Range.first; i < Range.second; ++i)
+      Trial[i] = randomLike(Trial[i], Rng);
+    if (PathOf(Trial) == PathHash) {
+      Colorized.swap(Trial);
+    } else if (Range.second - Range.first > 1) {
+      size_t Mid = (Range.first + Range.second) / 2;
+      Ranges.push_back({Range.first, Mid});
+      Ranges.push_back({Mid, Range.second});
+    }
+  }
+  return Colorized;
+}
+
+static uint64_t truncateTo(uint64_t Value, int Bytes) {
+  return Bytes >= 8 ? Value : Value & ((1ull << (8 * Bytes)) - 1);
+}
+
+static int64_t signExtend(uint64_t Value, int Bytes) {
+  int Shift = 64 - 8 * Bytes;
+  return (int64_t)(Value << Shift) >> Shift;
+}
+
+/**
+ * @brief Whether the Size-byte operand Value may have been read from
+ * Bytes bytes of input and then zero- or sign-extended.
+ */
+static bool fitsIn(uint64_t Value, int Bytes, int Size) {
+  uint64_t Narrow = truncateTo(Value, Bytes);
+  return Narrow == Value ||
+         truncateTo(signExtend(Narrow, Bytes), Size) == Value;
+}
+
+/**
+ * @brief Encode the low Bytes bytes of Value, little or big endian.
+ */
+static std::string encode(uint64_t Value, int Bytes, bool BigEndian) {
+  std::string Out(Bytes, '\0');
+  for (int i = 0; i < Bytes; ++i)
+    Out[BigEndian ? Bytes - 1 - i : i] = (char)(Value >> (8 * i));
+  return Out;
+}
+
+namespace {
+/**
+ * Runs patched inputs, each one only once, up to MAX_CMPLOG_CANDIDATES.
+ */
+struct CandidateRunner {
+  const std::function<void(std::string &)> &Run;
+  std::unordered_set<std::string> Tried;
+  std::string Buf;
+
+  bool full() const { return Tried.size() >= MAX_CMPLOG_CANDIDATES; }
+
+  void tryPatch(const std::string &Input, size_t Pos, size_t Len,
+                const std::string &Patch) {
+    if (full())
+      return;
+    Buf.assign(Input, 0, Pos);
+    Buf += Patch;
+    Buf.append(Input, Pos + Len, std::string::npos);
+    if (Buf == Input || !Tried.insert(Buf).second)
+      return;
+    Run(Buf);
+  }
+};
+} // namespace
+
+/**
+ * @brief Patch every place where Pattern appears in Input, as raw bytes
+ * or decimal text, with Repl and its neighbours (for < and > checks).
+ * With HasColor, raw matches must hold ColorPattern in Colorized too.
+ */
+static void patchOperand(const std::string &Input,
+                         const std::string &Colorized, uint64_t Pattern,
+                         uint64_t Repl, bool HasColor, uint64_t ColorPattern,
+                         int Size, CandidateRunner &Runner) {
+  if (Pattern == Repl)
+    return;
+
+  for (int Bytes = 1; Bytes <= Size; Bytes *= 2) {
+    if (!fitsIn(Pattern, Bytes, Size))
+      continue;
+    for (bool BigEndian : {false, true}) {
+      if (BigEndian && Bytes == 1)
+        break;
+      std::string Needle = encode(Pattern, Bytes, BigEndian);
+      std::string ColorNeedle = encode(ColorPattern, Bytes, BigEndian);
+      for (size_t Pos = Input.find(Needle); Pos != std::string::npos;
+           Pos = Input.find(Needle, Pos + 1)) {
+        if (HasColor && Colorized.compare(Pos, Bytes, ColorNeedle) != 0)
+          continue;
+        for (int Delta : {0, 1, -1}) {
+          uint64_t Value = truncateTo(Repl + Delta, Size);
+          if (fitsIn(Value, Bytes, Size))
+            Runner.tryPatch(Input, Pos, Bytes,
+                            encode(Value, Bytes, BigEndian));
+        }
+      }
+    }
+  }
+
+  // Numbers the target parsed from text.
+  std::string Needle = std::to_string(signExtend(Pattern, Size));
+  for (size_t Pos = Input.find(Needle); Pos != std::string::npos;
+       Pos = Input.find(Needle, Pos + 1)) {
+    size_t End = Pos + Needle.size();
+    if ((Pos > 0 && isdigit((unsigned char)Input[Pos - 1])) ||
+        (End < Input.size() && isdigit((unsigned char)Input[End])))
+      continue;
+    for (int Delta : {0, 1, -1})
+      Runner.tryPatch(Input, Pos, Needle.size(),
+                      std::to_string(signExtend(Repl, Size) + Delta));
+  }
+}
+
+size_t solveComparisons(const std::string &Input, const cmp_map &Cmps,
+                        const std::string &Colorized,
+                        const cmp_map &ColorCmps,
+                        const std::function<void(std::string &)> &Run) {
+  CandidateRunner Runner{Run, {}, {}};
+  bool Colored = Colorized.size() == Input.size() && Colorized != Input;
+
+  for (int Id = 0; Id < CMP_MAP_SIZE && !Runner.full(); ++Id) {
+    const cmp_header &Header = Cmps.headers[Id];
+    int Size = Header.size;
+    if (Size < 1 || Size > 8)
+      continue;
+    unsigned Logged = std::min<unsigned>(Header.hits, CMP_LOG_LEN);
+    unsigned ColorLogged =
+        Colored ? std::min<unsigned>(ColorCmps.headers[Id].hits, CMP_LOG_LEN)
+                : 0;
+    for (unsigned i = 0; i < Logged; ++i) {
+      const cmp_operands &Ops = Cmps.log[Id][i];
+      bool HasColor = i < ColorLogged;
+      cmp_operands ColorOps = HasColor ? ColorCmps.log[Id][i] : Ops;
+      patchOperand(Input, Colorized, Ops.a, Ops.b, HasColor, ColorOps.a, Size,
+                   Runner);
+      patchOperand(Input, Colorized, Ops.b, Ops.a, HasColor, ColorOps.b, Size,
+                   Runner);
+    }
+  }
+  return Runner.Tried.size();
+}
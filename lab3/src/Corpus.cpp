@@ -0,0 +1,25 @@
+#include "Corpus.h"
+
+Corpus::Corpus(int NumShards) {
+  for (int i = 0; i < NumShards; ++i)
+    Shards.emplace_back(new Shard());
+}
+
+bool Corpus::add(int ShardIdx, std::shared_ptr<QueueEntry> Entry) {
+  Shard &S = *Shards[ShardIdx % Shards.size()];
+  std::lock_guard<std::mutex> Guard(S.Lock);
+  if (!S.Seen.insert(Entry->Input).second)
+    return false;
+  S.Entries.push_back(std::move(Entry));
+  Size.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void Corpus::snapshot(std::vector<std::shared_ptr<QueueEntry>> &Entries) {
+  Entries.clear();
+  Entries.reserve(size());
+  for (auto &S : Shards) {
+    std::lock_guard<std::mutex> Guard(S->Lock);
+    Entries.insert(Entries.end(), S->Entries.begin(), S->Entries.end());
+  }
+}
@@ -0,0 +1,132 @@
+#include "Coverage.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "Runtime.h"
+
+static const int MAP_WORDS = MAP_SIZE / 8;
+
+// Bucket bits seen so far over all runs, one 64-bit word per 8 map slots.
+static std::atomic<uint64_t> SeenBits[MAP_WORDS];
+
+static unsigned char bucketOf(int Count) {
+  if (Count == 0)
+    return 0;
+  if (Count <= 3)
+    return 1 << (Count - 1);
+  if (Count <= 7)
+    return 8;
+  if (Count <= 15)
+    return 16;
+  if (Count <= 31)
+    return 32;
+  if (Count <= 127)
+    return 64;
+  return 128;
+}
+
+struct CountClassTable {
+  unsigned char Bucket[256];
+  CountClassTable() {
+    for (int i = 0; i < 256; ++i)
+      Bucket[i] = bucketOf(i);
+  }
+};
+
+static const CountClassTable CountClass;
+
+void traceFromCoverageData(std::vector<std::string> &CoverageData,
+                           unsigned char *Trace) {
+  for (auto &Line : CoverageData) {
+    int L, C;
+    if (sscanf(Line.c_str(), "%d, %d", &L, &C) != 2)
+      continue;
+    unsigned char &Counter = Trace[coverage_index(L, C)];
+    if (Counter != 255)
+      ++Counter;
+  }
+}
+
+void classifyCounts(unsigned char *Trace) {
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word;
+    std::memcpy(&Word, Trace + i * 8, 8);
+    if (!Word)
+      continue;
+    for (int j = 0; j < 8; ++j)
+      Trace[i * 8 + j] = CountClass.Bucket[Trace[i * 8 + j]];
+  }
+}
+
+int hasNewBits(const unsigned char *Trace) {
+  int Result = 0;
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word;
+    std::memcpy(&Word, Trace + i * 8, 8);
+    if (!Word || !(Word & ~SeenBits[i].load(std::memory_order_relaxed)))
+      continue;
+
+    uint64_t Old = SeenBits[i].fetch_or(Word, std::memory_order_relaxed);
+    uint64_t New = Word & ~Old;
+    if (!New)
+      continue;
+    // A slot whose byte was all zero before has never been reached.
+    for (int j = 0; j < 8 && Result < 2; ++j) {
+      unsigned char NewByte = New >> (j * 8);
+      unsigned char OldByte = Old >> (j * 8);
+      if (NewByte)
+        Result = OldByte ? 1 : 2;
+    }
+  }
+  return Result;
+}
+
+uint32_t hashTrace(const unsigned char *Trace) {
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word;
+    std::memcpy(&Word, Trace + i * 8, 8);
+    if (!Word)
+      continue;
+    Hash = (Hash ^ (Word + i)) * 0x100000001b3ULL;
+    Hash ^= Hash >> 29;
+  }
+  return (uint32_t)(Hash ^ (Hash >> 32));
+}
+
+uint32_t hashSlots(const unsigned char *Trace) {
+  uint32_t Hash = 2166136261u;
+  for (int i = 0; i < MAP_SIZE; ++i)
+    if (Trace[i])
+      Hash = (Hash ^ i) * 16777619u;
+  return Hash;
+}
+
+void copySeenBits(unsigned char *Out) {
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word = SeenBits[i].load(std::memory_order_relaxed);
+    std::memcpy(Out + i * 8, &Word, 8);
+  }
+}
+
+void mergeSeenBits(const unsigned char *In) {
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word;
+    std::memcpy(&Word, In + i * 8, 8);
+    SeenBits[i].fetch_or(Word, std::memory_order_relaxed);
+  }
+}
+
+int countCoveredSlots() {
+  int Count = 0;
+  for (int i = 0; i < MAP_WORDS; ++i) {
+    uint64_t Word = SeenBits[i].load(std::memory_order_relaxed);
+    for (int j = 0; j < 8; ++j)
+      if ((Word >> (j * 8)) & 0xff)
+        ++Count;
+  }
+  return Count;
+}
@@ -0,0 +1,120 @@
+#include "Crashes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/wait.h>
+
+#include "Coverage.h"
+#include "Output.h"
+#include "Utils.h"
+
+static const auto SUMMARY_INTERVAL = std::chrono::seconds(1);
+
+static uint32_t mixHash(uint32_t Hash, uint32_t Value) {
+  return (Hash ^ Value) * 16777619u;
+}
+
+std::string crashSignature(int Status, const crash_info &Info,
+                           const unsigned char *Trace) {
+  if (Info.line > 0)
+    return "sanitize-" + std::to_string(Info.line) + "-" +
+           std::to_string(Info.col);
+
+  std::string How = WIFSIGNALED(Status)
+                        ? "signal" + std::to_string(WTERMSIG(Status))
+                        : "exit" + std::to_string(WEXITSTATUS(Status));
+
+  uint32_t Hash = 2166136261u;
+  unsigned Len = std::min<unsigned>(Info.trail_pos, CRASH_TRAIL_LEN);
+  if (Len > 0) {
+    for (unsigned i = Info.trail_pos - Len; i < Info.trail_pos; ++i)
+      Hash = mixHash(Hash, Info.trail[i % CRASH_TRAIL_LEN]);
+  } else {
+    Hash = hashSlots(Trace);
+  }
+
+  char Hex[9];
+  snprintf(Hex, sizeof(Hex), "%08x", Hash);
+  return How + "-" + Hex;
+}
+
+bool CrashBuckets::add(const std::string &Signature, const std::string &Input,
+                       const std::string &OutDir) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  ++Total;
+  Bucket &B = Buckets[Signature];
+  bool IsNew = B.Count++ == 0;
+  bool Save = IsNew || Input.size() < B.Size;
+  if (IsNew)
+    B.Path = "failure/input" + std::to_string(failureCount++);
+  if (Save) {
+    B.Size = Input.size();
+    Output.write(OutDir + "/" + B.Path, Input);
+  }
+
+  auto Now = std::chrono::steady_clock::now();
+  if (Save || Now - LastSummary >= SUMMARY_INTERVAL) {
+    writeSummary(OutDir);
+    LastSummary = Now;
+  }
+  return IsNew;
+}
+
+void CrashBuckets::load(const std::string &OutDir) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::ifstream Summary(OutDir + "/crash_summary.txt");
+  std::string Line;
+  while (std::getline(Summary, Line)) {
+    char Signature[128], Path[128];
+    Bucket B;
+    if (Line.empty() || Line[0] == '#' ||
+        sscanf(Line.c_str(), "%127s %ld %127s %zu", Signature, &B.Count, Path,
+               &B.Size) != 4)
+      continue;
+    B.Path = Path;
+    Total += B.Count;
+    Buckets[Signature] = B;
+  }
+}
+
+int CrashBuckets::unique() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Buckets.size();
+}
+
+long CrashBuckets::total() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Total;
+}
+
+void CrashBuckets::writeSummary(const std::string &OutDir) {
+  std::string Path = OutDir + "/crash_summary.txt";
+  std::string TmpPath = Path + ".tmp";
+  FILE *F = fopen(TmpPath.c_str(), "w");
+  if (!F)
+    return;
+  fprintf(F, "# signature crashes input size\n");
+  for (auto &Entry : Buckets)
+    fprintf(F, "%s %ld %s %zu\n", Entry.first.c_str(), Entry.second.Count,
+            Entry.second.Path.c_str(), Entry.second.Size);
+  fclose(F);
+  rename(TmpPath.c_str(), Path.c_str());
+}
+
+void crashInfoFromFiles(std::string &Target, crash_info &Info) {
+  std::memset(&Info, 0, sizeof(Info));
+  std::ifstream CrashFile(Target + ".crash");
+  std::string Line;
+  if (std::getline(CrashFile, Line))
+    sscanf(Line.c_str(), "%d, %d", &Info.line, &Info.col);
+
+  std::vector<std::string> CoverageData;
+  readCoverageFile(Target, CoverageData);
+  for (std::string &Entry : CoverageData) {
+    int LineNo, Col;
+    if (sscanf(Entry.c_str(), "%d, %d", &LineNo, &Col) == 2)
+      Info.trail[Info.trail_pos++ % CRASH_TRAIL_LEN] =
+          coverage_index(LineNo, Col);
+  }
+}
@@ -0,0 +1,220 @@
+#include "Deterministic.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static const int8_t Interesting8[] = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+
+static const int16_t Interesting16[] = {-32768, -129, 128,  255,  256,
+                                        512,    1000, 1024, 4096, 32767};
+
+static const int32_t Interesting32[] = {INT32_MIN, -100663046, -32769,
+                                        32768,     65535,      65536,
+                                        100663045, INT32_MAX};
+
+static const size_t BoundaryLengths[] = {0,   1,   2,   4,    8,    16,
+                                         32,  64,  100, 127,  128,  255,
+                                         256, 512, 1000, 1024, 4096};
+
+/**
+ * @brief Whether turning Old into New is one of the bit or byte flips.
+ */
+static bool couldBeBitflip(uint32_t Old, uint32_t New) {
+  uint32_t Diff = Old ^ New;
+  if (!Diff)
+    return true;
+
+  int Shift = __builtin_ctz(Diff);
+  Diff >>= Shift;
+  if (Diff == 1 || Diff == 3 || Diff == 15)
+    return true;
+  if (Shift & 7)
+    return false;
+  return Diff == 0xff || Diff == 0xffff || Diff == 0xffffffff;
+}
+
+/**
+ * @brief Whether turning the Len-byte word Old into New is one of the
+ * arithmetic mutations on words of at most Widest bytes.
+ */
+static bool couldBeArith(uint32_t Old, uint32_t New, int Len, int Widest) {
+  if (Old == New)
+    return true;
+  if (Widest < 1)
+    return false;
+
+  // A single byte that moved by at most ARITH_MAX.
+  int Changed = 0;
+  uint8_t OldByte = 0, NewByte = 0;
+  for (int i = 0; i < Len; ++i) {
+    uint8_t A = Old >> (8 * i), B = New >> (8 * i);
+    if (A != B) {
+      ++Changed;
+      OldByte = A;
+      NewByte = B;
+    }
+  }
+  if (Changed == 1 && ((uint8_t)(OldByte - NewByte) <= ARITH_MAX ||
+                       (uint8_t)(NewByte - OldByte) <= ARITH_MAX))
+    return true;
+  if (Widest < 2)
+    return false;
+
+  // A 16-bit word, in either byte order, that moved by at most ARITH_MAX.
+  for (int i = 0; i + 1 < Len; ++i) {
+    uint32_t Mask = 0xffffu << (8 * i);
+    if ((Old & ~Mask) != (New & ~Mask))
+      continue;
+    uint16_t A = Old >> (8 * i), B = New >> (8 * i);
+    uint16_t SA = __builtin_bswap16(A), SB = __builtin_bswap16(B);
+    if ((uint16_t)(A - B) <= ARITH_MAX || (uint16_t)(B - A) <= ARITH_MAX ||
+        (uint16_t)(SA - SB) <= ARITH_MAX || (uint16_t)(SB - SA) <= ARITH_MAX)
+      return true;
+  }
+  if (Widest < 4)
+    return false;
+
+  uint32_t SOld = __builtin_bswap32(Old), SNew = __builtin_bswap32(New);
+  return Old - New <= ARITH_MAX || New - Old <= ARITH_MAX ||
+         SOld - SNew <= ARITH_MAX || SNew - SOld <= ARITH_MAX;
+}
+
+static uint32_t swapBytes(uint32_t Value, int Len) {
+  if (Len == 1)
+    return Value;
+  if (Len == 2)
+    return __builtin_bswap16(Value);
+  return __builtin_bswap32(Value);
+}
+
+static uint32_t load(const std::string &Buf, size_t Pos, int Len) {
+  uint32_t Value = 0;
+  std::memcpy(&Value, Buf.data() + Pos, Len);
+  return Value;
+}
+
+static void store(std::string &Buf, size_t Pos, int Len, uint32_t Value) {
+  std::memcpy(&Buf[Pos], &Value, Len);
+}
+
+size_t runDeterministicStage(std::string &Buf,
+                             const std::function<void(std::string &)> &Run) {
+  size_t Len = std::min(Buf.size(), DETERMINISTIC_MAX_LEN);
+  size_t Execs = 0;
+
+  // Walking bit flips.
+  for (int Width : {1, 2, 4}) {
+    for (size_t Bit = 0; Bit + Width <= Len * 8; ++Bit) {
+      for (int i = 0; i < Width; ++i)
+        Buf[(Bit + i) / 8] ^= 128 >> ((Bit + i) % 8);
+      Run(Buf);
+      ++Execs;
+      for (int i = 0; i < Width; ++i)
+        Buf[(Bit + i) / 8] ^= 128 >> ((Bit + i) % 8);
+    }
+  }
+
+  // Walking byte flips.
+  for (int Width : {1, 2, 4}) {
+    for (size_t Pos = 0; Pos + Width <= Len; ++Pos) {
+      for (int i = 0; i < Width; ++i)
+        Buf[Pos + i] ^= 0xff;
+      Run(Buf);
+      ++Execs;
+      for (int i = 0; i < Width; ++i)
+        Buf[Pos + i] ^= 0xff;
+    }
+  }
+
+  // Arithmetic on words of each width and byte order.
+  for (int Width : {1, 2, 4}) {
+    for (size_t Pos = 0; Pos + Width <= Len; ++Pos) {
+      uint32_t Orig = load(Buf, Pos, Width);
+      for (bool Swap : {false, true}) {
+        if (Swap && Width == 1)
+          break;
+        uint32_t Value = Swap ? swapBytes(Orig, Width) : Orig;
+        for (int Delta = 1; Delta <= ARITH_MAX; ++Delta) {
+          for (int Sign : {1, -1}) {
+            uint32_t New = Value + Sign * Delta;
+            if (Swap)
+              New = swapBytes(New, Width);
+            if (Width < 4)
+              New &= (1u << (8 * Width)) - 1;
+            // Skip what flips or narrower arithmetic already tried.
+            if (couldBeBitflip(Orig, New) ||
+                couldBeArith(Orig, New, Width, Width / 2))
+              continue;
+            store(Buf, Pos, Width, New);
+            Run(Buf);
+            ++Execs;
+          }
+        }
+      }
+      store(Buf, Pos, Width, Orig);
+    }
+  }
+
+  // Interesting values.
+  for (int Width : {1, 2, 4}) {
+    std::vector<uint32_t> Values;
+    if (Width == 1)
+      for (int8_t V : Interesting8)
+        Values.push_back((uint8_t)V);
+    else if (Width == 2)
+      for (int16_t V : Interesting16)
+        Values.push_back((uint16_t)V);
+    else
+      for (int32_t V : Interesting32)
+        Values.push_back((uint32_t)V);
+    // Smaller interesting values are interesting at every width.
+    if (Width > 1)
+      for (int8_t V : Interesting8)
+        Values.push_back(Width == 2 ? (uint16_t)(int16_t)V : (uint32_t)V);
+    if (Width > 2)
+      for (int16_t V : Interesting16)
+        Values.push_back((uint32_t)(int32_t)V);
+
+    for (size_t Pos = 0; Pos + Width <= Len; ++Pos) {
+      uint32_t Orig = load(Buf, Pos, Width);
+      for (uint32_t Value : Values) {
+        for (bool Swap : {false, true}) {
+          if (Swap && Width == 1)
+            break;
+          uint32_t New = Swap ? swapBytes(Value, Width) : Value;
+          if (Swap && New == Value)
+            continue;
+          if (couldBeBitflip(Orig, New) ||
+              couldBeArith(Orig, New, Width, Width))
+            continue;
+          store(Buf, Pos, Width, New);
+          Run(Buf);
+          ++Execs;
+        }
+      }
+      store(Buf, Pos, Width, Orig);
+    }
+  }
+
+  // Boundary lengths. Padding goes before a trailing newline so that
+  // line-oriented targets see the longer line.
+  std::string Orig = Buf;
+  bool Newline = !Orig.empty() && Orig.back() == '\n';
+  for (size_t Target : BoundaryLengths) {
+    if (Target == Orig.size())
+      continue;
+    if (Target < Orig.size()) {
+      Buf.resize(Target);
+    } else {
+      Buf.insert(Newline ? Buf.size() - 1 : Buf.size(), Target - Buf.size(),
+                 'A');
+    }
+    Run(Buf);
+    ++Execs;
+    Buf = Orig;
+  }
+
+  return Execs;
+}
@@ -0,0 +1,154 @@
+#include "Dictionary.h"
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace dictionary {
+
+static cl::opt<std::string>
+    DictFile("dict-file",
+             cl::desc("Where to write the dictionary (default: the source "
+                      "file name with a .dict extension)"),
+             cl::value_desc("path"));
+
+// Longest token kept; longer literals are rarely compared whole.
+static const size_t MAX_TOKEN_LEN = 128;
+
+// Library functions whose constant string arguments become tokens.
+static const char *StringCompareFunctions[] = {
+    "strcmp", "strncmp", "strcasecmp", "strncasecmp",
+    "memcmp", "bcmp",    "strstr",     "strcasestr"};
+
+void Dictionary::addToken(StringRef Token) {
+  if (Token.empty())
+    return;
+  Tokens.insert(Token.substr(0, MAX_TOKEN_LEN).str());
+}
+
+/**
+ * Integers become their little-endian bytes at the compared width and
+ * their decimal text, since the targets mostly read text. Characters
+ * (compared at i8, or widened from i8) become the single byte.
+ */
+void Dictionary::addInteger(const APInt &Value, bool IsChar) {
+  if (IsChar || Value.getBitWidth() <= 8) {
+    addToken(StringRef(std::string(1, (char)Value.getZExtValue())));
+    return;
+  }
+  if (Value.getBitWidth() > 64)
+    return;
+
+  uint64_t Raw = Value.getZExtValue();
+  std::string Bytes;
+  for (unsigned i = 0; i < Value.getBitWidth() / 8; ++i)
+    Bytes += (char)(Raw >> (8 * i));
+  addToken(Bytes);
+  addToken(std::to_string(Value.getSExtValue()));
+}
+
+/**
+ * @brief Whether V is a value widened from i8, as C char comparisons are.
+ */
+static bool isWidenedChar(Value *V) {
+  auto *Cast = dyn_cast<CastInst>(V);
+  return Cast && (isa<SExtInst>(Cast) || isa<ZExtInst>(Cast)) &&
+         Cast->getSrcTy()->isIntegerTy(8);
+}
+
+/**
+ * @brief Escape Token in the AFL dictionary format.
+ */
+static std::string escapeToken(const std::string &Token) {
+  std::string Out = "\"";
+  for (unsigned char C : Token) {
+    if (C == '"' || C == '\\') {
+      Out += '\\';
+      Out += C;
+    } else if (C < 32 || C > 126) {
+      char Hex[5];
+      snprintf(Hex, sizeof(Hex), "\\x%02x", C);
+      Out += Hex;
+    } else {
+      Out += C;
+    }
+  }
+  return Out + "\"";
+}
+
+void Dictionary::writeDictionary(Module &M) {
+  std::string Path = DictFile;
+  if (Path.empty()) {
+    Path = M.getSourceFileName();
+    size_t Dot = Path.rfind('.');
+    if (Dot != std::string::npos && Path.find('/', Dot) == std::string::npos)
+      Path.erase(Dot);
+    Path += ".dict";
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(Path, EC);
+  if (EC) {
+    errs() << "Cannot write dictionary " << Path << ": " << EC.message()
+           << "\n";
+    return;
+  }
+  for (const std::string &Token : Tokens)
+    Out << escapeToken(Token) << "\n";
+}
+
+bool Dictionary::runOnModule(Module &M) {
+  for (Function &F : M) {
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      if (auto *Cmp = dyn_cast<ICmpInst>(&*I)) {
+        for (int i = 0; i < 2; ++i) {
+          auto *C = dyn_cast<ConstantInt>(Cmp->getOperand(i));
+          if (C)
+            addInteger(C->getValue(), isWidenedChar(Cmp->getOperand(1 - i)));
+        }
+      } else if (auto *Switch = dyn_cast<SwitchInst>(&*I)) {
+        bool IsChar = isWidenedChar(Switch->getCondition());
+        for (auto Case : Switch->cases())
+          addInteger(Case.getCaseValue()->getValue(), IsChar);
+      } else if (auto *Call = dyn_cast<CallInst>(&*I)) {
+        Function *Callee = Call->getCalledFunction();
+        if (!Callee)
+          continue;
+        bool IsCompare = false;
+        for (const char *Name : StringCompareFunctions)
+          IsCompare |= Callee->getName() == Name;
+        if (!IsCompare)
+          continue;
+
+        // memcmp(a, "lit", n) only compares the first n bytes.
+        uint64_t Limit = MAX_TOKEN_LEN;
+        if (Call->arg_size() > 2)
+          if (auto *N = dyn_cast<ConstantInt>(Call->getArgOperand(2)))
+            Limit = N->getZExtValue();
+        bool TrimAtNul =
+            Callee->getName() != "memcmp" && Callee->getName() != "bcmp";
+        for (int i = 0; i < 2; ++i) {
+          StringRef Str;
+          if (getConstantStringInfo(Call->getArgOperand(i), Str, 0,
+                                    TrimAtNul))
+            addToken(Str.substr(0, Limit));
+        }
+      }
+    }
+  }
+
+  writeDictionary(M);
+  return false;
+}
+
+char Dictionary::ID = 1;
+static RegisterPass<Dictionary>
+    X("Dictionary", "Fuzzer dictionary from comparison constants", false,
+      true);
+
+} // namespace dictionary
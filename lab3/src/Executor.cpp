@@ -0,0 +1,176 @@
+#include "Executor.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Runtime.h"
+
+/**
+ * @brief Replace the contents of the shared stdin file with Input and
+ * rewind it, so the next child reads Input from the start.
+ */
+static void writeInputFile(int Fd, std::string &Input) {
+  lseek(Fd, 0, SEEK_SET);
+  if (write(Fd, Input.data(), Input.size()) != (ssize_t)Input.size()) {
+    perror("Cannot write input file");
+    exit(1);
+  }
+  if (ftruncate(Fd, Input.size())) {
+    perror("Cannot truncate input file");
+    exit(1);
+  }
+  lseek(Fd, 0, SEEK_SET);
+}
+
+int startForkServer(ForkServer &Server, std::string &Target,
+                    std::string &InputPath) {
+  int CtlPipe[2], StPipe[2];
+
+  // A dead fork server must surface as a failed read, not kill the fuzzer.
+  signal(SIGPIPE, SIG_IGN);
+
+  // Close-on-exec, or fork servers other workers start at the same time
+  // inherit our ends and keep each other alive once the fuzzer is gone.
+  // dup2() clears the flag on the copies our own fork server keeps.
+  Server.InputPath = InputPath;
+  Server.InputFd = open(Server.InputPath.c_str(),
+                        O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (Server.InputFd < 0 || pipe2(CtlPipe, O_CLOEXEC) ||
+      pipe2(StPipe, O_CLOEXEC)) {
+    perror("Cannot set up fork server");
+    exit(1);
+  }
+
+  Server.Pid = fork();
+  if (Server.Pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+
+  if (Server.Pid == 0) {
+    // A SIGINT or SIGTERM sent to our process group (Ctrl-C, timeout) must
+    // not kill the fork server before the fuzzer has checkpointed; the
+    // fuzzer stops it with stopForkServer() instead.
+    setsid();
+    int DevNull = open("/dev/null", O_RDWR);
+    dup2(Server.InputFd, 0);
+    dup2(DevNull, 1);
+    dup2(DevNull, 2);
+    dup2(CtlPipe[0], FORKSRV_FD);
+    dup2(StPipe[1], FORKSRV_FD + 1);
+    close(DevNull);
+    close(Server.InputFd);
+    close(CtlPipe[0]);
+    close(CtlPipe[1]);
+    close(StPipe[0]);
+    close(StPipe[1]);
+    setMemoryLimit(Server.MemLimitMb);
+    setenv(FORKSRV_ENV_VAR, "1", 1);
+    if (Server.ShmId >= 0)
+      setenv(SHM_ENV_VAR, std::to_string(Server.ShmId).c_str(), 1);
+    if (Server.CmpShmId >= 0)
+      setenv(CMPLOG_SHM_ENV_VAR, std::to_string(Server.CmpShmId).c_str(), 1);
+    execl(Target.c_str(), Target.c_str(), (char *)NULL);
+    _exit(127);
+  }
+
+  close(CtlPipe[0]);
+  close(StPipe[1]);
+  Server.CtlFd = CtlPipe[1];
+  Server.StFd = StPipe[0];
+
+  int Hello;
+  if (read(Server.StFd, &Hello, 4) != 4) {
+    stopForkServer(Server);
+    return 1;
+  }
+  return 0;
+}
+
+void setMemoryLimit(size_t MemLimitMb) {
+  if (!MemLimitMb)
+    return;
+  struct rlimit Limit;
+  Limit.rlim_cur = Limit.rlim_max = (rlim_t)MemLimitMb << 20;
+  setrlimit(RLIMIT_AS, &Limit);
+}
+
+int runForkServer(ForkServer &Server, std::string &Input, int TimeoutMs) {
+  int Request = 0;
+  pid_t Child;
+  int Status;
+
+  writeInputFile(Server.InputFd, Input);
+
+  if (write(Server.CtlFd, &Request, 4) != 4 ||
+      read(Server.StFd, &Child, 4) != 4 || Child <= 0) {
+    fprintf(stderr, "Fork server is gone\n");
+    exit(1);
+  }
+
+  // The status only arrives once the child is done; kill it if it is not
+  // done in time. The fork server then reports it as killed.
+  bool TimedOut = false;
+  if (TimeoutMs > 0) {
+    struct pollfd Pfd = {Server.StFd, POLLIN, 0};
+    int Ready;
+    while ((Ready = poll(&Pfd, 1, TimeoutMs)) < 0 && errno == EINTR)
+      ;
+    if (Ready == 0) {
+      kill(Child, SIGKILL);
+      TimedOut = true;
+    }
+  }
+
+  if (read(Server.StFd, &Status, 4) != 4) {
+    fprintf(stderr, "Fork server is gone\n");
+    exit(1);
+  }
+  if (TimedOut)
+    return EXEC_TIMEOUT;
+  // A persistent child stops itself once it is done with an input.
+  if (WIFSTOPPED(Status))
+    return 0;
+  return Status;
+}
+
+void stopForkServer(ForkServer &Server) {
+  if (Server.Pid > 0) {
+    kill(Server.Pid, SIGKILL);
+    waitpid(Server.Pid, NULL, 0);
+  }
+  if (Server.CtlFd >= 0)
+    close(Server.CtlFd);
+  if (Server.StFd >= 0)
+    close(Server.StFd);
+  if (Server.InputFd >= 0)
+    close(Server.InputFd);
+  if (!Server.InputPath.empty())
+    unlink(Server.InputPath.c_str());
+  Server = ForkServer();
+}
+
+unsigned char *setupSharedMemory(int &ShmId, size_t Size) {
+  ShmId = shmget(IPC_PRIVATE, Size, IPC_CREAT | IPC_EXCL | 0600);
+  if (ShmId < 0) {
+    perror("shmget");
+    exit(1);
+  }
+  void *Map = shmat(ShmId, NULL, 0);
+  // Mark the segment for removal right away; Linux still lets targets
+  // attach to it, and it goes away with the last user even if we are killed.
+  shmctl(ShmId, IPC_RMID, NULL);
+  if (Map == (void *)-1) {
+    perror("shmat");
+    exit(1);
+  }
+  return (unsigned char *)Map;
+}
@@ -6,22 +6,42 @@
  * implementation, you don't have to modify it.
  */
 
+#include <csignal>
 #include <cstdlib>
 #include <fstream>
-#include <iostream>
+#include <getopt.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 #include <numeric>
 #include <unordered_set>
 
+#include "Bandit.h"
+#include "Checkpoint.h"
+#include "CmpLog.h"
+#include "Corpus.h"
+#include "Coverage.h"
+#include "Crashes.h"
+#include "Deterministic.h"
+#include "Executor.h"
+#include "Grammar.h"
+#include "Minimize.h"
+#include "Output.h"
+#include "Runtime.h"
+#include "Scheduler.h"
+#include "Stats.h"
 #include "Utils.h"
 
 #define ARG_EXIST_CHECK(Name, Arg)            \
@@ -35,31 +55,78 @@
   }                                           \
   std::string Name(Arg);
 
-#define DBG \
-  std::cout << "Hit F::" << __FILE__ << " ::L" << __LINE__ << std::endl
+// Largest input the mutations may produce.
+const size_t MAX_INPUT_SIZE = 1 << 16;
+
+/**
+ * Input buffer that mutations work on in place. Data never grows past
+ * Capacity, so a worker allocates its buffer once and reuses it for
+ * every run.
+ */
+struct Buffer
+{
+  std::string Data;
+  size_t Capacity;
+
+  explicit Buffer(size_t Capacity = MAX_INPUT_SIZE) : Capacity(Capacity)
+  {
+    Data.reserve(Capacity);
+  }
+
+  /**
+   * @return size_t number of bytes the input may still grow by.
+   */
+  size_t room() const
+  {
+    return Data.size() < Capacity ? Capacity - Data.size() : 0;
+  }
+};
 
 /**
  * @brief Type Signature of Mutation Function.
- * MutationFn takes a string as input and returns a string.
+ * MutationFn mutates the input in Buf in place, drawing random numbers
+ * from Rng.
  *
- * MutationFn: string -> string
+ * MutationFn: (Buffer&, Rng&) -> void
  */
-typedef std::string MutationFn(std::string);
+typedef void MutationFn(Buffer &, std::mt19937 &);
+
+// Most mutations stacked on one input, as a power of two (havoc).
+const int MAX_STACK_POW2 = 4;
+const int MAX_STACK = 1 << MAX_STACK_POW2;
 
 /**
  * Struct that holds useful information about
  * one run of the program.
  *
  * @param Passed       did the program run without crashing?
- * @param Mutation     mutation function used for this run.
- * @param Input        parent input used for generating input for this run.
- * @param MutatedInput input string for this run.
+ * @param Mutations    indices in MutationFns of the mutation functions
+ *                     applied, in order, for this run.
+ * @param NumMutations number of entries in Mutations.
+ * @param Parent       queue entry the input for this run was derived from.
+ * @param Input        input for this run, owned by the caller.
+ * @param ExecUs       execution time of this run in microseconds.
+ * @param TimedOut     was the run killed for exceeding the exec timeout?
+ * @param PathHash     checksum of the coverage of this run.
+ * @param NewCrash     did the run open a new crash bucket?
+ * @param Distance     mean distance of the run to the division sites in
+ *                     directed mode, -1 if it reached no block with one.
+ * @param Tree         derivation tree of the input in grammar mode.
  */
 struct RunInfo
 {
   bool Passed;
-  MutationFn *Mutation;
-  std::string Input, MutatedInput;
+  int Mutations[MAX_STACK];
+  int NumMutations = 0;
+  QueueEntry *Parent = nullptr;
+  std::string *Input = nullptr;
+  long ExecUs = 0;
+  bool TimedOut = false;
+  bool Stopped = false;
+  uint32_t PathHash = 0;
+  bool NewCrash = false;
+  double Distance = -1;
+  DerivationTree Tree;
 };
 
 /************************************************/
@@ -68,15 +135,42 @@ struct RunInfo
 /**
  * Note: Feel free to add/remove/change any of the following variables.
  * Depending on what you want to keep track of during fuzzing.
+ *
+ * Every worker thread (-j) runs its own fuzzing loop, so state that belongs
+ * to one loop is thread_local. Only the seeds, the queue and the global
+ * coverage map (see Coverage.h) are shared.
  */
 // Collection of strings used to generate inputs
 std::vector<std::string> SeedInputs;
 
-// Variable to store coverage related information.
-std::vector<std::string> CoverageState;
+// Grammar inputs are derived from in grammar mode (-g), and the derivation
+// trees of the generated seeds (null for seeds read from the seed dir).
+bool UseGrammar = false;
+Grammar InputGrammar;
+std::vector<DerivationTree> SeedTrees;
+
+// Number of derivations of the grammar added to the seeds.
+const int GRAMMAR_SEEDS = 32;
+
+// Tokens the target compares its input against, from Target.dict (written
+// by the Dictionary pass) or -x.
+std::vector<std::string> Dictionary;
+
+// Number of fuzzing workers (-j).
+int Jobs = 1;
 
-// Coverage related information from previous step.
-std::vector<std::string> PrevCoverageState;
+// Index of the worker running on this thread.
+thread_local int WorkerId = 0;
+
+// Random number stream of this worker.
+thread_local std::mt19937 Rng;
+
+/**
+ * @brief Draw a random number from this worker's stream.
+ *
+ * @return int random number in [0, RAND_MAX].
+ */
+int Rand() { return Rng() & RAND_MAX; }
 
 /**
  * @brief Variable to keep track of some Mutation related state.
@@ -90,21 +184,177 @@ int MutationState = 0;
  */
 int StrategyState = 0;
 
+// Run the target through a fork server instead of popen() (-f).
+bool UseForkServer = false;
+
+// Fork server of the target, valid when UseForkServer is set.
+thread_local ForkServer Server;
+
+// Read coverage from a shared-memory bitmap instead of Target.cov (-s).
+bool UseSharedMemory = false;
+
+// Coverage bitmap of the current run. Shared with the target when
+// UseSharedMemory is set, otherwise filled from Target.cov after the run.
+thread_local unsigned char *TraceBits = nullptr;
+
+// Backing store of TraceBits when coverage comes from Target.cov.
+thread_local std::vector<unsigned char> FileTraceBits(MAP_SIZE);
+
+// Crash site and trail of the current run, right after TraceBits in the
+// shared memory. Rebuilt from Target.crash and Target.cov otherwise.
+thread_local crash_info *CrashInfo = nullptr;
+thread_local crash_info FileCrashInfo;
+
+// Favour entries that get closer to the division sites (-D), annealing
+// from coverage-guided to distance-guided over DirectedExploitS seconds.
+bool UseDirected = false;
+double DirectedExploitS = 0;
+
+// Distance of the last run to the division sites, after the crash info
+// in shared memory. Stays empty in file mode.
+thread_local distance_info *DistanceInfo = nullptr;
+thread_local distance_info FileDistanceInfo;
+
+// Crashes found so far, one bucket per crash site.
+CrashBuckets Crashes;
+
+// Execs, finds and per-mutation yield, reported to fuzzer_stats/plot_data.
+StatsReporter Stats;
+
+// Whether to continue from the checkpoint in the output directory
+// (--resume) instead of running the seeds, and the periodic checkpoints.
+bool Resume = false;
+Checkpointer Checkpoints;
+
+// Clock and exec count the resumed campaign had reached.
+CampaignProgress Resumed;
+
+// Last checkpoint this worker saved its mutation scores for.
+thread_local int SavedEpoch = 0;
+
+// Save inputs to pack files instead of one file each (--pack).
+bool UsePack = false;
+
+// Set on SIGINT or SIGTERM, or at --max-execs; workers stop after their
+// current exec.
+volatile sig_atomic_t StopRequested = 0;
+volatile time_t StopRequestTime = 0;
+
+void requestStop(int Signal)
+{
+  // timeout(1) signals both us and our process group, so one stop can
+  // arrive twice at once. Only a signal a second later forces the exit.
+  time_t Now = time(NULL);
+  if (!StopRequested)
+  {
+    StopRequestTime = Now;
+    StopRequested = 1;
+  }
+  else if (Now - StopRequestTime >= 1)
+  {
+    signal(Signal, SIG_DFL);
+    raise(Signal);
+  }
+}
+
+// Stop the campaign after this many execs (--max-execs), 0 for no limit.
+long MaxExecs = 0;
+
+// Exec timeout in milliseconds (-t), 0 to derive it from the seeds.
+int ExecTimeoutMs = 0;
+
+// Bounds and seed multiple of the derived exec timeout, and the timeout
+// the seeds themselves run under.
+const int MIN_TIMEOUT_MS = 50;
+const int MAX_TIMEOUT_MS = 1000;
+const int TIMEOUT_FACTOR = 10;
+const int CALIBRATION_TIMEOUT_MS = 10000;
+
+// Slowest exec time of a seed, in microseconds.
+std::atomic<long> MaxSeedExecUs(0);
+
+// Whether this worker is still running its seeds.
+thread_local bool Calibrating = false;
+
+// Workers done running their seeds.
+std::atomic<int> CalibratedWorkers(0);
+
+// Address space limit of the target in MiB (-m), 0 for none.
+size_t MemLimitMb = 1024;
+
+// Runs killed for exceeding the timeout, and the paths of those saved.
+std::atomic<int> HangTotal(0);
+std::mutex HangLock;
+std::unordered_set<uint32_t> HangPaths;
+
+// Run the deterministic stage on every new queue entry (-d).
+bool UseDeterministic = false;
+
+// Buffer the deterministic stage mutates in place.
+thread_local std::string DeterministicBuffer;
+
+// Every havoc run mutates a copy of its base input in this buffer.
+thread_local Buffer HavocBuffer;
+
+// Other queue entries each picked entry is spliced with.
+const int SPLICE_CYCLES = 4;
+
+// Base input of the current splice cycle.
+thread_local std::string SpliceBuffer;
+
+// Solve comparisons logged by a -cmplog target on every new queue entry (-c).
+bool UseCmpLog = false;
+
+// Fork server whose children log comparisons, valid when UseCmpLog is set.
+thread_local ForkServer CmpServer;
+
+// Comparison log shared with CmpServer's children.
+thread_local cmp_map *CmpMap = nullptr;
+
+// Comparison logs of a queue entry and of its colorized version.
+thread_local cmp_map EntryCmps, ColorCmps;
+
 /************************************************/
 /*    Implement your select input algorithm     */
 /************************************************/
 
-// Global map to store the scores of each input
-std::map<std::string, int> InputScores;
+// The fuzzing queue, shared between all workers (one shard per worker)
+const int CORPUS_SHARDS = 64;
+Corpus Queue(CORPUS_SHARDS);
+
+// This worker's view of the queue and its power schedule. Rebuilt when
+// the queue grew, and every REBUILD_INTERVAL picks as path stats change.
+const int REBUILD_INTERVAL = 64;
+thread_local std::vector<std::shared_ptr<QueueEntry>> QueueSnapshot;
+thread_local std::vector<double> QueueScores;
+thread_local AliasTable QueueTable;
+thread_local ScheduleStats QueueStats;
+thread_local int PicksSinceRebuild = 0;
+
+// Defined with the other stages below.
+void trimEntry(QueueEntry &Entry);
 
-// Function to update the scores based on the feedback
-void updateInputScores(RunInfo info, bool newCoverage)
+/**
+ * @brief Add the input of a run to the queue if it found new coverage,
+ * trimmed to the shortest version with the same path.
+ *
+ * @param Info RunInfo of the run.
+ * @param newCoverage whether the run found new coverage.
+ */
+void updateQueue(RunInfo &Info, bool newCoverage)
 {
-  if (newCoverage || !info.Passed)
-  {
-    // encourage exploration of inputs that led to crash or new coverage
-    InputScores[info.Input] += 10;
-  }
+  if (!newCoverage || !Info.Passed)
+    return;
+  auto Entry = std::make_shared<QueueEntry>();
+  Entry->Input = *Info.Input;
+  Entry->ExecUs = Info.ExecUs;
+  Entry->PathHash = Info.PathHash;
+  Entry->Depth = Info.Parent ? Info.Parent->Depth + 1 : 0;
+  Entry->Tree = Info.Tree;
+  Entry->Distance = Info.Distance;
+  trimEntry(*Entry);
+  if (Queue.add(WorkerId, std::move(Entry)))
+    Stats.countPathFind();
 }
 
 /**
@@ -114,50 +364,53 @@ void updateInputScores(RunInfo info, bool newCoverage)
  */
 std::string generateRandomInput()
 {
-  int length = rand() % 256; // Random length between 0 and 255
+  int length = Rand() % 256; // Random length between 0 and 255
   std::string randomInput;
   for (int i = 0; i < length; ++i)
   {
-    randomInput += static_cast<char>(rand() % 256); // Random byte
+    randomInput += static_cast<char>(Rand() % 256); // Random byte
   }
   return randomInput;
 }
 
 /**
- * @brief Select a string that will be mutated to generate a new input.
- * Sample code picks the first input string from SeedInputs.
+ * @brief Select a queue entry that will be mutated to generate new inputs,
+ * and how many inputs to generate from it.
  *
- * TODO: Implement your logic for selecting a input to mutate.
- * If you require, you can use the Info variable to help make a
- * decision while selecting a Seed but it is not necessary for the lab.
+ * Entries are drawn from an alias table weighted by the power schedule
+ * (see Scheduler.h), so a pick costs O(1) however long the queue gets.
  *
- * @param RunInfo struct with information about the previous run.
- * @return Pointer to a string.
+ * @param Energy set to the number of mutations to run on the entry.
+ * @return QueueEntry* the selected entry.
  */
-std::string selectInput(RunInfo Info)
+QueueEntry *selectInput(int &Energy)
 {
-  const double randomSelectionProbability = 0.20;
-
-  // Randomly explore new inputs
-  if (rand() / ((double)RAND_MAX) < randomSelectionProbability)
+  if (QueueSnapshot.size() != Queue.size() ||
+      ++PicksSinceRebuild >= REBUILD_INTERVAL)
   {
-    // Fallback to a random seed input if nothing was selected yet
-    int randomIndex = rand() % SeedInputs.size();
-    return SeedInputs[randomIndex];
+    PicksSinceRebuild = 0;
+    Queue.snapshot(QueueSnapshot);
+    QueueStats = computeStats(QueueSnapshot);
+    QueueScores.resize(QueueSnapshot.size());
+    std::vector<double> Weights(QueueSnapshot.size());
+    double Temperature =
+        annealingTemperature(Stats.elapsedMs() / 1000.0, DirectedExploitS);
+    for (size_t i = 0; i < QueueSnapshot.size(); ++i)
+    {
+      QueueScores[i] = calculateScore(*QueueSnapshot[i], QueueStats);
+      if (UseDirected)
+        QueueScores[i] *=
+            directedFactor(*QueueSnapshot[i], QueueStats, Temperature);
+      Weights[i] = selectionWeight(*QueueSnapshot[i], QueueScores[i]);
+    }
+    QueueTable.build(Weights);
   }
 
-  // prioritize re-exploring any input that has scored (indicating led to crash or new coverage)
-  // choose random input from the scored inputs
-  if (InputScores.size() > 0)
-  {
-    int randomIndex = rand() % InputScores.size();
-    auto it = InputScores.begin();
-    std::advance(it, randomIndex);
-    return it->first;
-  }
-  // If no scored inputs, choose random input from the seed inputs
-  int randomIndex = rand() % SeedInputs.size();
-  return SeedInputs[randomIndex];
+  size_t Index = QueueTable.sample(Rng);
+  QueueEntry *Entry = QueueSnapshot[Index].get();
+  Energy = assignEnergy(*Entry, QueueScores[Index], QueueStats);
+  Entry->TimesPicked.fetch_add(1, std::memory_order_relaxed);
+  return Entry;
 }
 
 /*********************************************/
@@ -169,31 +422,31 @@ const int LENGTH_ALPHA = sizeof(ALPHA);
 
 /**
  * Here we provide a two sample mutation functions
- * that take as input a string and returns a string.
+ * that mutate the input buffer in place.
  */
 
 /**
  * @brief Mutation Strategy that does nothing.
  *
- * @param Original Original input string.
- * @return std::string mutated string.
+ * @param Buf Input buffer to mutate.
+ * @param Rng Random number stream.
  */
-std::string mutationA(std::string Original) { return Original; }
+void mutationA(Buffer &Buf, std::mt19937 &Rng) {}
 
 /**
  * @brief Mutation Strategy that inserts a random
- * alpha numeric char at a random location in Original.
+ * alpha numeric char at a random location in Buf.
  *
- * @param Original Original input string.
- * @return std::string mutated string.
+ * @param Buf Input buffer to mutate.
+ * @param Rng Random number stream.
  */
-std::string mutationB(std::string Original)
+void mutationB(Buffer &Buf, std::mt19937 &Rng)
 {
-  if (Original.length() <= 0)
-    return Original;
+  if (Buf.Data.length() <= 0 || Buf.room() < 1)
+    return;
 
-  int Index = rand() % Original.length();
-  return Original.insert(Index, 1, ALPHA[rand() % LENGTH_ALPHA]);
+  int Index = Rng() % Buf.Data.length();
+  Buf.Data.insert(Index, 1, ALPHA[Rng() % LENGTH_ALPHA]);
 }
 
 /**
@@ -208,225 +461,275 @@ std::string mutationB(std::string Original)
 /**
  * @brief Swap two adjacent bytes in the string at random
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string swapAdjacentBytes(std::string original)
+void swapAdjacentBytes(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.length() <= 1)
-    return original;
+  if (buf.Data.length() <= 1)
+    return;
 
-  int index = rand() % (original.length() - 1);
-  std::swap(original[index], original[index + 1]);
-  return original;
+  int index = rng() % (buf.Data.length() - 1);
+  std::swap(buf.Data[index], buf.Data[index + 1]);
 }
 
 /**
  * @brief Increment a random byte in the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string incrementByte(std::string original)
+void incrementByte(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.length() <= 0)
-    return original;
+  if (buf.Data.length() <= 0)
+    return;
 
-  int index = rand() % original.length();
-  original[index] = (original[index] + 1) % 256;
-  return original;
+  int index = rng() % buf.Data.length();
+  buf.Data[index] = (buf.Data[index] + 1) % 256;
 }
 
 /**
  * @brief Remove random byte from the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string removeByte(std::string original)
+void removeByte(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.length() <= 0)
-    return original;
+  if (buf.Data.length() <= 0)
+    return;
 
-  int index = rand() % original.length();
-  original.erase(index, 1);
-  return original;
+  int index = rng() % buf.Data.length();
+  buf.Data.erase(index, 1);
 }
 
 /**
  * @brief Add random byte to the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-
-std::string addByte(std::string original)
+void addByte(Buffer &buf, std::mt19937 &rng)
 {
-  int index = rand() % (original.length() + 1);
-  char newByte = rand() % 256;
-  original.insert(index, 1, newByte);
-  return original;
+  if (buf.room() < 1)
+    return;
+
+  int index = rng() % (buf.Data.length() + 1);
+  char newByte = rng() % 256;
+  buf.Data.insert(index, 1, newByte);
 }
 
 /**
  * @brief add random number of random bytes to the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-
-std::string addRandomBytes(std::string original)
+void addRandomBytes(Buffer &buf, std::mt19937 &rng)
 {
   // add random number of bytes from 1 to 256
-  int numBytes = rand() % 256;
+  int numBytes = std::min<size_t>(rng() % 256, buf.room());
   // add random bytes
   for (int i = 0; i < numBytes; ++i)
   {
-    char newByte = rand() % 256;
-    original += newByte;
+    char newByte = rng() % 256;
+    buf.Data += newByte;
   }
-  return original;
 }
 
 /**
  * @brief add random number of the same character to the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string addSameBytes(std::string original)
+void addSameBytes(Buffer &buf, std::mt19937 &rng)
 {
   // add random number of bytes from 1 to 256
-  int numBytes = rand() % 256;
+  int numBytes = std::min<size_t>(rng() % 256, buf.room());
 
   // fix character
-  char newByte = rand() % 256;
-  // add random bytes
-  for (int i = 0; i < numBytes; ++i)
-  {
-
-    original += newByte;
-  }
-  return original;
+  char newByte = rng() % 256;
+  buf.Data.append(numBytes, newByte);
 }
 
 /**
- * Add specific length input
- * @param length Length of the input string.
- * @param character Character to fill the input string.
- * @return std::string input string.
+ * @brief Replace the input with three newline-terminated lines of 'a's.
+ *
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string generateSpecificLengthInput(int length, char character = 'a')
-{
-  std::string input;
-  for (int i = 0; i < length; ++i)
-  {
-    input += character;
-  }
-  return input;
-}
-
-std::string addRandomNewlineBuffers(std::string original)
+void addRandomNewlineBuffers(Buffer &buf, std::mt19937 &rng)
 {
   // random length between 20 and 70
-  auto lengthOne = rand() % 50 + 20;
+  auto lengthOne = rng() % 50 + 20;
   // length between 30 and 200
-  auto lengthTwo = rand() % 170 + 30;
+  auto lengthTwo = rng() % 170 + 30;
   // length between 120 and 300
-  auto lengthThree = rand() % 180 + 120;
-
-  std::string buf0 = generateSpecificLengthInput(lengthOne);   // length between 20 and 70
-  std::string buf1 = generateSpecificLengthInput(lengthTwo);   // length between 30 and 200
-  std::string buf2 = generateSpecificLengthInput(lengthThree); // length between 120 and 300
-
-  return buf0 + "\n" + buf1 + "\n" + buf2 + "\n";
+  auto lengthThree = rng() % 180 + 120;
+  if (lengthOne + lengthTwo + lengthThree + 3 > buf.Capacity)
+    return;
+
+  buf.Data.assign(lengthOne, 'a');
+  buf.Data += '\n';
+  buf.Data.append(lengthTwo, 'a');
+  buf.Data += '\n';
+  buf.Data.append(lengthThree, 'a');
+  buf.Data += '\n';
 }
 
 // Function to add random characters to the input string and set the 25th character
-std::string addLengthAndSetCharacter(std::string original)
+void addLengthAndSetCharacter(Buffer &buf, std::mt19937 &rng)
 {
+  // Random length between 250 and 350
+  int additionalLength = 250 + rng() % 100;
+  if (std::max<size_t>(buf.Data.length(), 25) + additionalLength > buf.Capacity)
+    return;
+
   // Ensure the input string is at least 25 characters long
-  while (original.length() < 25)
+  while (buf.Data.length() < 25)
   {
-    original += static_cast<char>('a' + rand() % 26); // Add random lowercase letters
+    buf.Data += static_cast<char>('a' + rng() % 26); // Add random lowercase letters
   }
 
   // Set the 25th character to 'a', 'b', or 'c'
-  original[24] = "abc"[rand() % 3];
+  buf.Data[24] = "abc"[rng() % 3];
 
   // Add more random characters to increase the length
-  int additionalLength = 250 + rand() % 100; // Random length between 250 and 350
   for (int i = 0; i < additionalLength; ++i)
   {
-    original += static_cast<char>('a' + rand() % 26); // Add random lowercase letters
+    buf.Data += static_cast<char>('a' + rng() % 26); // Add random lowercase letters
   }
-
-  return original;
 }
 
 /**
  * @brief Reverse the entire input string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string reverseString(std::string original)
+void reverseString(Buffer &buf, std::mt19937 &rng)
 {
-  std::reverse(original.begin(), original.end());
-  return original;
+  std::reverse(buf.Data.begin(), buf.Data.end());
 }
 
 /**
  * @brief Duplicate a random byte in the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string duplicateRandomByte(std::string original)
+void duplicateRandomByte(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.length() <= 0)
-    return original;
+  if (buf.Data.length() <= 0 || buf.room() < 1)
+    return;
 
-  int index = rand() % original.length();
-  char byteToDuplicate = original[index];
-  original.insert(index, 1, byteToDuplicate);
-  return original;
+  int index = rng() % buf.Data.length();
+  char byteToDuplicate = buf.Data[index];
+  buf.Data.insert(index, 1, byteToDuplicate);
 }
 
 /**
  * @brief Duplicate a random substring within the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string duplicateSubstring(std::string original)
+void duplicateSubstring(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.length() < 2)
-    return original;
-
-  int start = rand() % original.length();
-  int length = rand() % (original.length() - start);
-  std::string substring = original.substr(start, length);
-  int insertPos = rand() % original.length();
-  original.insert(insertPos, substring);
-  return original;
+  if (buf.Data.length() < 2)
+    return;
+
+  int start = rng() % buf.Data.length();
+  int length = std::min<size_t>(rng() % (buf.Data.length() - start),
+                                buf.room());
+  int insertPos = rng() % buf.Data.length();
+  // Copies out of the string's own storage before inserting.
+  buf.Data.insert(insertPos, buf.Data, start, length);
 }
 
 /**
  * @brief Flip a random bit in the string.
  *
- * @param original Original input string.
- * @return std::string mutated string.
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
+ */
+void flipRandomBit(Buffer &buf, std::mt19937 &rng)
+{
+  if (buf.Data.empty())
+    return;
+
+  int byteIndex = rng() % buf.Data.length();
+  int bitIndex = rng() % 8;
+  buf.Data[byteIndex] ^= (1 << bitIndex);
+}
+
+/**
+ * @brief Insert a dictionary token at a random location.
+ *
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
  */
-std::string flipRandomBit(std::string original)
+void insertToken(Buffer &buf, std::mt19937 &rng)
 {
-  if (original.empty())
-    return original;
+  if (Dictionary.empty())
+    return;
+
+  const std::string &token = Dictionary[rng() % Dictionary.size()];
+  if (token.length() > buf.room())
+    return;
+  int index = rng() % (buf.Data.length() + 1);
+  buf.Data.insert(index, token);
+}
+
+/**
+ * @brief Overwrite the bytes at a random location with a dictionary token.
+ *
+ * @param buf Input buffer to mutate.
+ * @param rng Random number stream.
+ */
+void overwriteToken(Buffer &buf, std::mt19937 &rng)
+{
+  if (Dictionary.empty())
+    return;
+
+  const std::string &token = Dictionary[rng() % Dictionary.size()];
+  if (token.length() > buf.Data.length())
+    return insertToken(buf, rng);
+  int index = rng() % (buf.Data.length() - token.length() + 1);
+  buf.Data.replace(index, token.length(), token);
+}
+
+/**
+ * @brief Splice two inputs: keep the head of First up to a random point
+ * between the first and last byte where it differs from Second, and
+ * continue with Second's tail from there.
+ *
+ * @param First input to take the head from.
+ * @param Second input to take the tail from.
+ * @param Out set to the spliced input.
+ * @param rng Random number stream.
+ * @return bool false if the inputs differ too little to splice.
+ */
+bool spliceInputs(const std::string &First, const std::string &Second,
+                  std::string &Out, std::mt19937 &rng)
+{
+  size_t length = std::min(First.length(), Second.length());
+  size_t firstDiff = 0;
+  while (firstDiff < length && First[firstDiff] == Second[firstDiff])
+    ++firstDiff;
+  size_t lastDiff = length;
+  while (lastDiff > firstDiff && First[lastDiff - 1] == Second[lastDiff - 1])
+    --lastDiff;
+  if (lastDiff - firstDiff < 2)
+    return false;
 
-  int byteIndex = rand() % original.length();
-  int bitIndex = rand() % 8;
-  original[byteIndex] ^= (1 << bitIndex);
-  return original;
+  size_t splitAt = firstDiff + 1 + rng() % (lastDiff - firstDiff - 1);
+  Out.assign(First, 0, splitAt);
+  Out.append(Second, splitAt, std::string::npos);
+  if (Out.length() > MAX_INPUT_SIZE)
+    Out.resize(MAX_INPUT_SIZE);
+  return true;
 }
 
 /**
@@ -450,94 +753,90 @@ std::vector<MutationFn *> MutationFns = {
     duplicateRandomByte,
     reverseString,
     duplicateSubstring,
-    flipRandomBit};
-
-// Global vector to store the scores of each mutation function
-std::vector<int> MutationScores(MutationFns.size(), 1);
+    flipRandomBit,
+    insertToken,
+    overwriteToken};
+
+// Names of the functions in MutationFns, in the same order, for fuzzer_stats.
+std::vector<std::string> MutationNames = {
+    "mutationA",
+    "mutationB",
+    "swapAdjacentBytes",
+    "incrementByte",
+    "removeByte",
+    "addByte",
+    "addRandomBytes",
+    "addSameBytes",
+    "addRandomNewlineBuffers",
+    "addLengthAndSetCharacter",
+    "duplicateRandomByte",
+    "reverseString",
+    "duplicateSubstring",
+    "flipRandomBit",
+    "insertToken",
+    "overwriteToken"};
+
+// Reward of a run that reached a new map slot (a new hit-count bucket
+// earns half of it) or opened a new crash bucket.
+const double NEW_SLOT_REWARD = 2;
+const double NEW_CRASH_REWARD = 2;
+
+// Bandit choosing the mutation functions of this worker's havoc stacks.
+thread_local MutationBandit MutationScheduler(MutationFns.size());
 
 /**
  * @brief Update the mutation scores based on feedback of the previous run.
  * @param Info RunInfo struct with information about the previous run.
- * @param newCoverage boolean indicating if there was new line coverage
+ * @param NewBits value of hasNewBits() for the run, 0 if it timed out.
  */
-void updateMutationScores(RunInfo &Info, bool newCoverage)
+void updateMutationScores(RunInfo &Info, int NewBits)
 {
-  // Find the function that was run
-  int index = std::distance(MutationFns.begin(), std::find(MutationFns.begin(), MutationFns.end(), Info.Mutation));
-
-  // If new coverage was found, increase the score significantly
-  if (newCoverage)
-  {
-    MutationScores[index] += 10;
-  }
-  // increase score significantly if this mutation led to a crash
-  if (!Info.Passed)
+  if (Info.NumMutations == 0)
+    return;
+  // Credit every function in the stack that was run with an equal share
+  // of the run's cost, so mutations are compared per CPU-second.
+  double Reward = NewBits * NEW_SLOT_REWARD / 2;
+  if (Info.NewCrash)
+    Reward += NEW_CRASH_REWARD;
+  double CostUs = (double)Info.ExecUs / Info.NumMutations;
+  for (int i = 0; i < Info.NumMutations; ++i)
   {
-    MutationScores[index] += 10;
+    MutationScheduler.reward(Info.Mutations[i], Reward, CostUs);
+    Stats.countMutation(Info.Mutations[i], NewBits > 0,
+                        !Info.Passed && !Info.TimedOut);
   }
 }
 
-// Global vector to track the number of times each mutation function has been used
-std::vector<int> MutationUsageCount(MutationFns.size(), 0);
-
-// Minimum number of times each mutation function should be tried
-const int MIN_TRIES_PER_MUTATION = 5;
-
 /**
- * @brief Select a mutation function to apply to the seed input.
- * Sample code picks a random Strategy.
+ * @brief Select a mutation function to apply to the seed input, through
+ * the bandit (see Bandit.h).
  *
- * TODO: Add your own logic to select a mutation function from MutationFns.
- * Hint: You may want to make use of any global state you store
- * during feedback to make decisions on what MutationFn to choose.
- *
- * @param RunInfo struct with information about the current run.
- * @returns a pointer to a MutationFn
+ * @returns int index of the function in MutationFns.
  */
-// Select a mutation function based on their scores with some randomness
-MutationFn *selectMutationFn(RunInfo &Info)
+int selectMutationFn()
 {
-  // Check if any mutation function has been used less than the minimum required times
-  // This guarantees that all functions are used at least MIN_TRIES_PER_MUTATION times
-  for (size_t i = 0; i < MutationUsageCount.size(); ++i)
-  {
-    if (MutationUsageCount[i] < MIN_TRIES_PER_MUTATION)
-    {
-      MutationUsageCount[i]++;
-      return MutationFns[i];
-    }
-  }
-  // Next, we use a weighted random selection based on the scores
-  const double randomSelectionProbability = 0.20;
-
-  // Select a random mutation function with a certain probability
-  if ((rand() / (double)RAND_MAX) < randomSelectionProbability)
-  {
-    int randomIndex = rand() % MutationFns.size();
-    return MutationFns[randomIndex];
-  }
-
-  // prioritize exploring mutation functions that led to crash or new coverage
-  // randomly select function from one that has already scored
-  std::vector<int> scoredMutationIndices;
-  for (size_t i = 0; i < MutationScores.size(); ++i)
-  {
-    if (MutationScores[i] > 1)
-    {
-      scoredMutationIndices.push_back(i);
-    }
-  }
-  if (scoredMutationIndices.size() > 0)
-  {
-    int randomIndex = rand() % scoredMutationIndices.size();
-    return MutationFns[scoredMutationIndices[randomIndex]];
-  }
-
-  return MutationFns.back(); // Fallback in case of rounding errors
+  return MutationScheduler.select(Rng);
 }
 /*********************************************/
 /*     Implement your feedback algorithm     */
 /*********************************************/
+/**
+ * @brief Load the trace of the last run into TraceBits, if it was not
+ * written there through shared memory, and bucket its hit counts.
+ *
+ * @param Target name of target binary
+ */
+void collectTrace(std::string &Target)
+{
+  if (!UseSharedMemory)
+  {
+    std::vector<std::string> RawCoverageData;
+    readCoverageFile(Target, RawCoverageData);
+    traceFromCoverageData(RawCoverageData, TraceBits);
+  }
+  classifyCounts(TraceBits);
+}
+
 /**
  * Update the internal state of the fuzzer using coverage feedback.
  *
@@ -546,84 +845,151 @@ MutationFn *selectMutationFn(RunInfo &Info)
  */
 void feedBack(std::string &Target, RunInfo &Info)
 {
-  std::vector<std::string> RawCoverageData;
-  readCoverageFile(Target, RawCoverageData);
+  if (Info.Stopped)
+    return;
+  // A killed run's coverage is cut short; it was already kept in hangs/.
+  // Its mutations are still charged for the time it took.
+  if (Info.TimedOut)
+  {
+    updateMutationScores(Info, 0);
+    return;
+  }
 
-  // track current and exisiting coverage lines in a set for easy lookup
-  std::unordered_set<std::string> PrevCoverageSet(PrevCoverageState.begin(), PrevCoverageState.end());
-  std::unordered_set<std::string> CurrentCoverageSet(CoverageState.begin(), CoverageState.end());
+  // Compare against everything seen during the campaign, by any worker,
+  // with hit counts bucketed so that new loop trip counts also count.
+  collectTrace(Target);
+  int NewBits = hasNewBits(TraceBits);
+  bool newCoverage = NewBits > 0;
+  Info.PathHash = hashTrace(TraceBits);
+  recordPath(Info.PathHash);
+  if (DistanceInfo->count)
+    Info.Distance = (double)DistanceInfo->sum / DistanceInfo->count;
+
+  // Update the mutation scores based on the feedback (stages have none)
+  updateMutationScores(Info, NewBits);
+  // Seeds are queued even if an earlier one covered the same.
+  updateQueue(Info, newCoverage || Calibrating);
+}
 
-  // Check if there was any new coverage by seeing if the current coverage set contains something different
-  // than the existing coverage set
-  bool newCoverage = false;
-  for (const auto &line : CurrentCoverageSet)
+int Freq = 1000;
+std::atomic<int> PassCount(0);
+
+/**
+ * @brief Timeout of the next run: -t if given, otherwise TIMEOUT_FACTOR
+ * times the slowest seed within [MIN_TIMEOUT_MS, MAX_TIMEOUT_MS].
+ *
+ * @return int timeout in milliseconds.
+ */
+int execTimeoutMs()
+{
+  if (ExecTimeoutMs > 0)
+    return ExecTimeoutMs;
+  if (Calibrating)
+    return CALIBRATION_TIMEOUT_MS;
+  long Ms = MaxSeedExecUs.load() * TIMEOUT_FACTOR / 1000;
+  return std::min<long>(std::max<long>(Ms, MIN_TIMEOUT_MS), MAX_TIMEOUT_MS);
+}
+
+/**
+ * @brief Count a run that timed out, and save its input if no saved hang
+ * covered the same map slots.
+ */
+void storeHang(std::string &Target, std::string &Input, std::string &OutDir)
+{
+  ++HangTotal;
+  if (!UseSharedMemory)
   {
-    if (PrevCoverageSet.find(line) == PrevCoverageSet.end())
-    {
-      newCoverage = true;
-      break;
-    }
+    std::vector<std::string> RawCoverageData;
+    readCoverageFile(Target, RawCoverageData);
+    traceFromCoverageData(RawCoverageData, TraceBits);
+  }
+  std::lock_guard<std::mutex> Guard(HangLock);
+  if (HangPaths.insert(hashSlots(TraceBits)).second)
+  {
+    storeHangingInput(Input, OutDir);
+    Stats.countHangFind();
   }
+}
 
-  // Update the coverage state for the next run
-  PrevCoverageState = CoverageState;
-  // Clear the coverage state for the next run
-  CoverageState.clear();
-  // Update the mutation scores based on the feedback
-  updateMutationScores(Info, newCoverage);
-  updateInputScores(Info, newCoverage);
-
-  // // dump current scores to file
-  // std::string scorePath = Target + ".score";
-  // std::ofstream scoreFile(scorePath, std::ios::trunc);
-  // scoreFile << "Mutation Scores: ";
-  // for (const auto &score : MutationScores)
-  // {
-  //   scoreFile << score << " ";
-  // }
-  // scoreFile << "\n";
-  // scoreFile << "Input Scores: ";
-  // for (const auto &pair : InputScores)
-  // {
-  //   scoreFile << pair.first << ": " << pair.second << " ";
-  // }
-  // scoreFile << "\n";
-  // scoreFile.close();
-  /**
-   * TODO: Implement your logic to use the coverage information from the test
-   * phase to guide fuzzing. The sky is the limit!
-   *
-   * Hint: You want to rely on some amount of randomness to make decisions.
-   *
-   * You have the Coverage information of the previous test in
-   * PrevCoverageState. And the raw coverage data is loaded into RawCoverageData
-   * from the Target.cov file. You can either use this raw data directly or
-   * process it (not-necessary). If you do some processing, make sure to update
-   * CoverageState to make it available in the next call to feedback.
-   */
-  CoverageState.assign(RawCoverageData.begin(),
-                       RawCoverageData.end()); // No extra processing
+/**
+ * @brief Write fuzzer_stats and plot_data now.
+ *
+ * @param Final whether this is the last write of the campaign.
+ */
+void writeStats(bool Final = false)
+{
+  StatsSample Sample;
+  Sample.CorpusSize = Queue.size();
+  Sample.CoveredSlots = countCoveredSlots();
+  Sample.UniqueCrashes = Crashes.unique();
+  Sample.Crashes = Crashes.total();
+  Sample.Hangs = HangTotal.load();
+  Sample.ExecTimeoutMs = execTimeoutMs();
+  Stats.write(Sample, Final);
 }
 
-int Freq = 1000;
-int Count = 0;
-int PassCount = 0;
+/**
+ * @brief Write fuzzer_stats and plot_data if a second has passed since
+ * they were last written.
+ */
+void reportStats()
+{
+  if (Stats.due())
+    writeStats();
+}
 
-bool test(std::string &Target, std::string &Input, std::string &OutDir)
+bool test(std::string &Target, std::string &Input, std::string &OutDir,
+          RunInfo &Info)
 {
-  // Clean up old coverage file before running
-  std::string CoveragePath = Target + ".cov";
-  std::remove(CoveragePath.c_str());
+  // Once the campaign stops, the current stage runs out without execs.
+  if (StopRequested)
+  {
+    Info.Stopped = true;
+    return false;
+  }
+  std::memset(TraceBits, 0, MAP_SIZE);
+  std::memset(CrashInfo, 0, sizeof(crash_info));
+  std::memset(DistanceInfo, 0, sizeof(distance_info));
+  if (!UseSharedMemory)
+  {
+    // Clean up old coverage and crash files before running
+    std::string CoveragePath = Target + ".cov";
+    std::remove(CoveragePath.c_str());
+    std::string CrashPath = Target + ".crash";
+    std::remove(CrashPath.c_str());
+  }
 
-  ++Count;
-  int ReturnCode = runTarget(Target, Input);
-  if (ReturnCode == 127)
+  Stats.countExec();
+  auto Start = std::chrono::steady_clock::now();
+  int Timeout = execTimeoutMs();
+  int ReturnCode = UseForkServer
+                       ? runForkServer(Server, Input, Timeout)
+                       : runTarget(Target, Input, Timeout, MemLimitMb);
+  Info.ExecUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - Start)
+                    .count();
+  Info.TimedOut = ReturnCode == EXEC_TIMEOUT;
+  if (!Info.TimedOut && WIFEXITED(ReturnCode) &&
+      WEXITSTATUS(ReturnCode) == 127)
   {
     fprintf(stderr, "%s not found\n", Target.c_str());
     exit(1);
   }
-  fprintf(stderr, "\e[A\rTried %d inputs, %d crashes found\n", Count,
-          failureCount);
+  reportStats();
+  if (MaxExecs && Stats.execs() >= MaxExecs)
+    StopRequested = 1;
+  // SIGINT/SIGTERM also reach a target run without a fork server, which is
+  // in our process group; the run they interrupted is not a crash.
+  if (StopRequested)
+  {
+    Info.Stopped = true;
+    return false;
+  }
+  if (Info.TimedOut)
+  {
+    storeHang(Target, Input, OutDir);
+    return false;
+  }
   if (ReturnCode == 0)
   {
     if (PassCount++ % Freq == 0)
@@ -632,56 +998,571 @@ bool test(std::string &Target, std::string &Input, std::string &OutDir)
   }
   else
   {
-    storeCrashingInput(Input, OutDir);
+    if (!UseSharedMemory)
+      crashInfoFromFiles(Target, *CrashInfo);
+    Info.NewCrash = Crashes.add(
+        crashSignature(ReturnCode, *CrashInfo, TraceBits), Input, OutDir);
+    if (Info.NewCrash)
+      Stats.countCrashFind(Crashes.unique());
     return false;
   }
 }
 
 /**
- * @brief Fuzz the Target program and store the results to OutDir
+ * @brief Run Runs inputs made by stacking 1 to MAX_STACK random mutations
+ * on Base.
  *
  * @param Target Target (instrumented) program binary.
  * @param OutDir Directory to store fuzzing results.
+ * @param Entry queue entry the inputs are derived from.
+ * @param Base input to mutate: Entry's own or one spliced from it.
+ * @param Runs number of inputs to run.
  */
-void fuzz(std::string Target, std::string OutDir)
+void havocStage(std::string &Target, std::string &OutDir, QueueEntry *Entry,
+                const std::string &Base, int Runs)
 {
   struct RunInfo Info;
-  while (true)
+  for (int i = 0; i < Runs; ++i)
   {
-    std::string Input = selectInput(Info);
     Info = RunInfo();
-    Info.Input = Input;
-    Info.Mutation = selectMutationFn(Info);
-    Info.MutatedInput = Info.Mutation(Info.Input);
-    Info.Passed = test(Target, Info.MutatedInput, OutDir);
+    Info.Parent = Entry;
+    Info.Input = &HavocBuffer.Data;
+    HavocBuffer.Data.assign(Base, 0, HavocBuffer.Capacity);
+    int Stack = 1 << (Rand() % (MAX_STACK_POW2 + 1));
+    for (int j = 0; j < Stack; ++j)
+    {
+      int Mutation = selectMutationFn();
+      Info.Mutations[Info.NumMutations++] = Mutation;
+      MutationFns[Mutation](HavocBuffer, Rng);
+    }
+    Info.Passed = test(Target, HavocBuffer.Data, OutDir, Info);
+    feedBack(Target, Info);
+  }
+}
+
+/**
+ * @brief Run the deterministic stage (see Deterministic.h) on Entry.
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param OutDir Directory to store fuzzing results.
+ * @param Entry queue entry to mutate.
+ */
+void deterministicStage(std::string &Target, std::string &OutDir,
+                        QueueEntry *Entry)
+{
+  DeterministicBuffer.assign(Entry->Input);
+  struct RunInfo Info;
+  runDeterministicStage(DeterministicBuffer, [&](std::string &Input) {
+    Info = RunInfo();
+    Info.Parent = Entry;
+    Info.Input = &Input;
+    Info.Passed = test(Target, Input, OutDir, Info);
+    feedBack(Target, Info);
+  });
+}
+
+/**
+ * @brief Run Input through the comparison-logging fork server.
+ *
+ * @param Input input to provide to the target.
+ * @param Cmps filled with the comparisons Input made.
+ */
+void logComparisons(std::string &Input, cmp_map &Cmps)
+{
+  std::memset(CmpMap, 0, sizeof(cmp_map));
+  runForkServer(CmpServer, Input, execTimeoutMs());
+  std::memcpy(&Cmps, CmpMap, sizeof(cmp_map));
+}
+
+/**
+ * @brief Checksum of the comparisons Input makes (see logComparisons).
+ */
+uint32_t hashComparisons(std::string &Input)
+{
+  std::memset(CmpMap, 0, sizeof(cmp_map));
+  runForkServer(CmpServer, Input, execTimeoutMs());
+  uint32_t Hash = 2166136261u;
+  const unsigned char *Bytes = (const unsigned char *)CmpMap;
+  for (size_t i = 0; i < sizeof(cmp_map); ++i)
+    Hash = (Hash ^ Bytes[i]) * 16777619u;
+  return Hash;
+}
+
+/**
+ * @brief Run the comparison solving stage (see CmpLog.h) on Entry.
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param OutDir Directory to store fuzzing results.
+ * @param Entry queue entry to mutate.
+ */
+void cmpLogStage(std::string &Target, std::string &OutDir, QueueEntry *Entry)
+{
+  struct RunInfo Info;
+  auto Run = [&](std::string &Input) {
+    Info = RunInfo();
+    Info.Parent = Entry;
+    Info.Input = &Input;
+    Info.Passed = test(Target, Input, OutDir, Info);
     feedBack(Target, Info);
+    return Info.PathHash;
+  };
+
+  std::string Input = Entry->Input;
+  std::string Colorized = colorize(Input, Entry->PathHash, Rng, Run);
+  logComparisons(Input, EntryCmps);
+  logComparisons(Colorized, ColorCmps);
+  solveComparisons(Input, EntryCmps, Colorized, ColorCmps,
+                   [&](std::string &Patched) { Run(Patched); });
+}
+
+// Target and output directory of this worker, for stages started from
+// feedback (trimming).
+thread_local std::string *WorkerTarget = nullptr;
+thread_local std::string *WorkerOutDir = nullptr;
+
+// Trimming removes chunks of 1/TRIM_START_STEPS of the input (rounded up to
+// a power of two) down to 1/TRIM_END_STEPS, but not below TRIM_MIN_BYTES.
+const size_t TRIM_MIN_BYTES = 4;
+const size_t TRIM_START_STEPS = 16;
+const size_t TRIM_END_STEPS = 1024;
+
+thread_local std::string TrimBuffer;
+
+/**
+ * @brief Shrink Entry, before it is queued, by removing power-of-two sized
+ * chunks for as long as the input still passes with the same path.
+ * Bytes the target reads without branching on them yet would be trimmed
+ * away, so seeds are kept as given, and with -c the comparisons the input
+ * makes must stay the same too: a comparison against a number the input
+ * does not hold yet is what the comparison solving stage patches.
+ * Grammar inputs are left alone, as removing bytes breaks their syntax.
+ *
+ * @param Entry new queue entry, not yet visible to other workers.
+ */
+void trimEntry(QueueEntry &Entry)
+{
+  if (UseGrammar || !WorkerTarget || Entry.Depth == 0 ||
+      Entry.Input.size() <= TRIM_MIN_BYTES)
+    return;
+
+  size_t LenP2 = 1;
+  while (LenP2 < Entry.Input.size())
+    LenP2 <<= 1;
+  size_t Remove = std::max(LenP2 / TRIM_START_STEPS, TRIM_MIN_BYTES);
+  size_t MinRemove = std::max(LenP2 / TRIM_END_STEPS, TRIM_MIN_BYTES);
+
+  uint32_t CmpHash = UseCmpLog ? hashComparisons(Entry.Input) : 0;
+  struct RunInfo Info;
+  for (; Remove >= MinRemove; Remove /= 2)
+  {
+    size_t Pos = 0;
+    while (Pos < Entry.Input.size() && Entry.Input.size() > Remove)
+    {
+      TrimBuffer.assign(Entry.Input, 0, Pos);
+      if (Pos + Remove < Entry.Input.size())
+        TrimBuffer.append(Entry.Input, Pos + Remove, std::string::npos);
+
+      Info = RunInfo();
+      Info.Input = &TrimBuffer;
+      bool SamePath = test(*WorkerTarget, TrimBuffer, *WorkerOutDir, Info);
+      if (SamePath)
+      {
+        collectTrace(*WorkerTarget);
+        SamePath = hashTrace(TraceBits) == Entry.PathHash &&
+                   (!UseCmpLog || hashComparisons(TrimBuffer) == CmpHash);
+      }
+      if (SamePath)
+      {
+        Entry.Input.swap(TrimBuffer);
+        Entry.ExecUs = Info.ExecUs;
+      }
+      else
+      {
+        Pos += Remove;
+      }
+    }
+  }
+}
+
+// Most tree mutations stacked on one input, as a power of two.
+const int GRAMMAR_STACK_POW2 = 2;
+
+/**
+ * @brief Run Runs inputs derived from Entry's tree by stacked tree
+ * mutations (see Grammar.h), splicing from random queue entries. Entries
+ * without a tree (seeds from the seed dir) get fresh derivations.
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param OutDir Directory to store fuzzing results.
+ * @param Entry queue entry to mutate.
+ * @param Runs number of inputs to run.
+ */
+void grammarStage(std::string &Target, std::string &OutDir, QueueEntry *Entry,
+                  int Runs)
+{
+  struct RunInfo Info;
+  for (int i = 0; i < Runs; ++i)
+  {
+    Info = RunInfo();
+    DerivationTree Tree = Entry->Tree;
+    if (!Tree)
+      Tree = InputGrammar.generate(Rng);
+    else
+    {
+      int Steps = 1 << (Rand() % (GRAMMAR_STACK_POW2 + 1));
+      for (int s = 0; s < Steps; ++s)
+      {
+        QueueEntry *Donor = QueueSnapshot[Rand() % QueueSnapshot.size()].get();
+        Tree = InputGrammar.mutate(Tree, Donor->Tree, Rng);
+      }
+    }
+    if (!InputGrammar.serialize(Tree, HavocBuffer.Data, MAX_INPUT_SIZE))
+      continue;
+
+    Info.Parent = Entry;
+    Info.Input = &HavocBuffer.Data;
+    Info.Tree = Tree;
+    Info.Passed = test(Target, HavocBuffer.Data, OutDir, Info);
+    feedBack(Target, Info);
+  }
+}
+
+/**
+ * @brief Checkpoint the campaign now, with its clock and exec count.
+ */
+void saveCheckpoint(std::string &OutDir)
+{
+  CampaignProgress Progress;
+  Progress.ElapsedMs = Stats.elapsedMs();
+  Progress.Execs = Stats.execs();
+  Checkpoints.save(OutDir, Queue, Progress);
+}
+
+/**
+ * @brief Write the final stats, checkpoint the campaign and write out the
+ * inputs still queued for saving, once every worker has returned.
+ */
+void finishCampaign(std::string &OutDir)
+{
+  writeStats(true);
+  saveCheckpoint(OutDir);
+  Output.stop();
+  fprintf(stderr, "Stopped, resume with --resume\n");
+}
+
+/**
+ * @brief Fuzz the Target program and store the results to OutDir
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param OutDir Directory to store fuzzing results.
+ */
+void fuzz(std::string Target, std::string OutDir)
+{
+  WorkerTarget = &Target;
+  WorkerOutDir = &OutDir;
+
+  if (UseSharedMemory)
+  {
+    int ShmId;
+    TraceBits = setupSharedMemory(ShmId);
+    CrashInfo = (crash_info *)(TraceBits + MAP_SIZE);
+    DistanceInfo = (distance_info *)(CrashInfo + 1);
+    if (!UseForkServer)
+      setenv(SHM_ENV_VAR, std::to_string(ShmId).c_str(), 1);
+    Server.ShmId = ShmId;
+  }
+  else
+  {
+    TraceBits = FileTraceBits.data();
+    CrashInfo = &FileCrashInfo;
+    DistanceInfo = &FileDistanceInfo;
+  }
+  if (UseForkServer)
+  {
+    std::string InputPath = OutDir + "/.cur_input";
+    if (Jobs > 1)
+      InputPath += std::to_string(WorkerId);
+    Server.MemLimitMb = MemLimitMb;
+    if (startForkServer(Server, Target, InputPath))
+    {
+      fprintf(stderr, "%s did not start a fork server, is it linked against "
+                      "libruntime?\n",
+              Target.c_str());
+      exit(1);
+    }
+  }
+
+  if (UseCmpLog)
+  {
+    CmpMap = (cmp_map *)setupSharedMemory(CmpServer.CmpShmId,
+                                          sizeof(cmp_map));
+    // The comparison-logging runs report coverage too; give them a bitmap
+    // of their own, or they would append to Target.cov.
+    setupSharedMemory(CmpServer.ShmId);
+    std::string InputPath = OutDir + "/.cmp_input";
+    if (Jobs > 1)
+      InputPath += std::to_string(WorkerId);
+    CmpServer.MemLimitMb = MemLimitMb;
+    if (startForkServer(CmpServer, Target, InputPath))
+    {
+      fprintf(stderr, "%s did not start a fork server, is it linked against "
+                      "libruntime?\n",
+              Target.c_str());
+      exit(1);
+    }
+  }
+
+  // Run this worker's share of the seeds to put them in the queue with
+  // their exec time and path. A resumed campaign has its queue already.
+  // The slowest seed sets the exec timeout unless -t gave one.
+  if (Resume)
+    MutationScheduler.restore(loadWorkerScores(OutDir, WorkerId));
+  Calibrating = true;
+  for (size_t i = WorkerId; !Resume && i < SeedInputs.size(); i += Jobs)
+  {
+    struct RunInfo Seed;
+    Seed.Input = &SeedInputs[i];
+    if (UseGrammar)
+      Seed.Tree = SeedTrees[i];
+    Seed.Passed = test(Target, SeedInputs[i], OutDir, Seed);
+    if (Seed.Stopped)
+      break;
+    if (Seed.TimedOut)
+    {
+      fprintf(stderr, "Seed %zu timed out, skipping it\n\n", i);
+      continue;
+    }
+    long Slowest = MaxSeedExecUs.load();
+    while (Seed.ExecUs > Slowest &&
+           !MaxSeedExecUs.compare_exchange_weak(Slowest, Seed.ExecUs))
+      ;
+    // Crashing seeds are queued too.
+    Seed.Passed = true;
+    feedBack(Target, Seed);
+  }
+  Calibrating = false;
+  ++CalibratedWorkers;
+  while (Queue.size() == 0 && !StopRequested)
+  {
+    if (CalibratedWorkers == Jobs)
+    {
+      fprintf(stderr, "Every seed timed out, nothing to fuzz\n");
+      exit(1);
+    }
+    std::this_thread::yield();
   }
+
+  while (!StopRequested)
+  {
+    int Energy;
+    QueueEntry *Entry = selectInput(Energy);
+    if (UseGrammar)
+    {
+      // Byte-level stages would break the input's syntax.
+      grammarStage(Target, OutDir, Entry, Energy);
+    }
+    else
+    {
+      if (UseCmpLog && !Entry->CmpLogDone.exchange(true))
+        cmpLogStage(Target, OutDir, Entry);
+      if (UseDeterministic && !Entry->DeterministicDone.exchange(true))
+        deterministicStage(Target, OutDir, Entry);
+      havocStage(Target, OutDir, Entry, Entry->Input, Energy);
+
+      // Cross the entry with others, keeping its head and their tails.
+      for (int i = 0; i < SPLICE_CYCLES && QueueSnapshot.size() > 1; ++i)
+      {
+        QueueEntry *Other =
+            QueueSnapshot[Rand() % QueueSnapshot.size()].get();
+        if (Other == Entry ||
+            !spliceInputs(Entry->Input, Other->Input, SpliceBuffer, Rng))
+          continue;
+        havocStage(Target, OutDir, Entry, SpliceBuffer,
+                   std::max(1, Energy / SPLICE_CYCLES));
+      }
+    }
+
+    if (Checkpoints.due())
+      saveCheckpoint(OutDir);
+    if (SavedEpoch != Checkpoints.epoch())
+    {
+      SavedEpoch = Checkpoints.epoch();
+      saveWorkerScores(OutDir, WorkerId, MutationScheduler.state());
+    }
+  }
+
+  // Fork servers run in their own session, out of reach of the signal that
+  // stopped us.
+  stopForkServer(Server);
+  stopForkServer(CmpServer);
 }
 
 /**
  * Usage:
- * ./fuzzer [target] [seed input dir] [output dir] [frequency] [random seed]
+ * ./fuzzer [-f] [-s] [-p] [-d] [-c] [-j N] [-x dict] [-t ms] [-m mb]
+ *          [-D s] [-g grammar] [--resume] [--pack] [--max-execs N] [target]
+ *          [seed input dir]
+ *          [output dir] [frequency] [random seed]
+ *
+ * -f  run the target through a fork server.
+ * -s  collect coverage through a shared-memory bitmap.
+ * -p  persistent mode: run many inputs per target process through
+ *     __fuzzer_loop() (implies -f).
+ * -j  run N fuzzing workers in parallel over a shared corpus (implies -f -s).
+ * -d  run deterministic bit flips, arithmetic and interesting values over
+ *     every new queue entry before random mutations.
+ * -x  read dictionary tokens from this file instead of [target].dict.
+ * -c  solve the comparisons of every new queue entry, patching input bytes
+ *     equal to one operand with the other. Needs a target built with
+ *     -cmplog (implies -f -s).
+ * -t  kill runs after this many milliseconds and save them to hangs/
+ *     (default: 10x the slowest seed, between 50 and 1000).
+ * -m  limit the target's address space to this many MiB (default 1024,
+ *     0 for none).
+ * -D  directed mode: favour inputs whose runs get closer to the division
+ *     sites, shifting from coverage to distance guidance over this many
+ *     seconds (simulated annealing, see Scheduler.h). Needs a target built
+ *     with -directed (implies -f -s).
+ * -g  generate inputs from this grammar (see Grammar.h) and mutate their
+ *     derivation trees instead of their bytes, so every input is
+ *     syntactically valid. Byte-level stages (-d, -c) are not run.
+ * --resume  continue the campaign checkpointed in [output dir] instead of
+ *           starting from the seeds. The random seed is mixed with the
+ *           checkpointed exec count, so the mutations are not replayed.
+ * --pack    append saved inputs to success.pack, failure.pack and
+ *           hangs.pack instead of writing a file per input (see Output.h).
+ * --max-execs N  stop as on SIGINT after N runs of the target.
+ *
+ * Progress is written once a second to [output dir]/fuzzer_stats and
+ * appended to [output dir]/plot_data (see Stats.h). The queue, coverage
+ * and scheduler state are checkpointed to [output dir]/queue every 30
+ * seconds (see Checkpoint.h).
+ *
+ * Inputs are saved by a background thread. On SIGINT or SIGTERM the
+ * workers stop after their current exec, the campaign is checkpointed and
+ * pending inputs are written out; another signal a second later kills
+ * the fuzzer.
+ *
+ * ./fuzzer --minimize-corpus [-j N] [target] [corpus dir] [output dir]
+ *
+ * Copy the smallest subset of corpus dir that keeps its total coverage to
+ * output dir, replaying inputs on N threads (all cores by default).
  */
 int main(int argc, char **argv)
 {
+  static struct option LongOptions[] = {
+      {"minimize-corpus", no_argument, NULL, 'M'},
+      {"resume", no_argument, NULL, 'R'},
+      {"pack", no_argument, NULL, 'K'},
+      {"max-execs", required_argument, NULL, 'E'},
+      {NULL, 0, NULL, 0}};
+  bool MinimizeCorpus = false;
+  bool JobsGiven = false;
+  std::string DictionaryPath;
+  std::string GrammarPath;
+  int Opt;
+  while ((Opt = getopt_long(argc, argv, "fspdcj:x:t:m:D:g:", LongOptions, NULL)) != -1)
+  {
+    switch (Opt)
+    {
+    case 'f':
+      UseForkServer = true;
+      break;
+    case 's':
+      UseSharedMemory = true;
+      break;
+    case 'p':
+      UseForkServer = true;
+      setenv(PERSISTENT_ENV_VAR, "1", 1);
+      break;
+    case 'd':
+      UseDeterministic = true;
+      break;
+    case 'j':
+      Jobs = std::max(1, atoi(optarg));
+      JobsGiven = true;
+      break;
+    case 'c':
+      UseCmpLog = true;
+      break;
+    case 't':
+      ExecTimeoutMs = std::max(0, atoi(optarg));
+      break;
+    case 'm':
+      MemLimitMb = std::max(0, atoi(optarg));
+      break;
+    case 'x':
+      DictionaryPath = optarg;
+      break;
+    case 'D':
+      UseDirected = true;
+      DirectedExploitS = atof(optarg);
+      break;
+    case 'g':
+      GrammarPath = optarg;
+      UseGrammar = true;
+      break;
+    case 'M':
+      MinimizeCorpus = true;
+      break;
+    case 'R':
+      Resume = true;
+      break;
+    case 'K':
+      UsePack = true;
+      break;
+    case 'E':
+      MaxExecs = std::max(0L, atol(optarg));
+      break;
+    default:
+      return 1;
+    }
+  }
+  // Drop the options so the positional arguments start at argv[1] again.
+  argv[optind - 1] = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if (argc < 4)
   {
-    printf("usage %s [target] [seed input dir] [output dir] [frequency "
-           "(optional)] [seed (optional arg)]\n",
+    printf("usage %s [-f] [-s] [-p] [-d] [-c] [-j N] [-x dict] [-t ms] "
+           "[-m mb] [-D s] [-g grammar] [--resume] [--pack] [--max-execs N] "
+           "[target] "
+           "[seed input dir] [output dir] "
+           "[frequency (optional)] "
+           "[seed (optional arg)]\n",
            argv[0]);
     return 1;
   }
 
+  if (MinimizeCorpus)
+    mkdir(argv[3], 0755);
+
   ARG_EXIST_CHECK(Target, argv[1]);
   ARG_EXIST_CHECK(SeedInputDir, argv[2]);
   ARG_EXIST_CHECK(OutDir, argv[3]);
 
+  if (MinimizeCorpus)
+  {
+    if (!JobsGiven)
+      Jobs = std::max(1u, std::thread::hardware_concurrency());
+    // Corpus entries get the same benefit of the doubt as seeds.
+    int TimeoutMs =
+        ExecTimeoutMs > 0 ? ExecTimeoutMs : CALIBRATION_TIMEOUT_MS;
+    if (minimizeCorpus(Target, SeedInputDir, OutDir, Jobs, TimeoutMs,
+                       MemLimitMb))
+    {
+      fprintf(stderr, "Cannot read corpus directory\n");
+      return 1;
+    }
+    return 0;
+  }
+
   if (argc >= 5)
     Freq = strtol(argv[4], NULL, 10);
 
   int RandomSeed = argc > 5 ? strtol(argv[5], NULL, 10) : (int)time(NULL);
 
-  srand(RandomSeed);
   storeSeed(OutDir, RandomSeed);
   initialize(OutDir);
 
@@ -690,11 +1571,99 @@ int main(int argc, char **argv)
     fprintf(stderr, "Cannot read seed input directory\n");
     return 1;
   }
+  if (UseGrammar)
+  {
+    std::string Error;
+    if (InputGrammar.load(GrammarPath, Error))
+    {
+      fprintf(stderr, "Bad grammar %s: %s\n", GrammarPath.c_str(),
+              Error.c_str());
+      return 1;
+    }
+    // Seeds from the seed dir are kept but have no tree; add derivations.
+    std::mt19937 SeedRng(RandomSeed);
+    SeedTrees.assign(SeedInputs.size(), nullptr);
+    for (int i = 0; i < GRAMMAR_SEEDS; ++i)
+    {
+      std::string Input;
+      DerivationTree Tree = InputGrammar.generate(SeedRng);
+      if (!InputGrammar.serialize(Tree, Input, MAX_INPUT_SIZE))
+        continue;
+      SeedInputs.push_back(Input);
+      SeedTrees.push_back(Tree);
+    }
+    if (UseDeterministic || UseCmpLog)
+      fprintf(stderr, "-d and -c are ignored with -g\n");
+  }
+  // After loading the grammar, which decodes the checkpointed trees.
+  if (Resume)
+  {
+    int Loaded = Checkpoints.load(OutDir, Queue, Resumed,
+                                  UseGrammar ? &InputGrammar : nullptr);
+    if (Loaded < 0)
+    {
+      fprintf(stderr, "No checkpoint to resume in %s\n", OutDir.c_str());
+      return 1;
+    }
+    resumeCounts(OutDir);
+    Crashes.load(OutDir);
+    // Entries of depth 0 are the seeds; calibrate the timeout on them.
+    std::vector<std::shared_ptr<QueueEntry>> Entries;
+    Queue.snapshot(Entries);
+    for (auto &Entry : Entries)
+      if (Entry->Depth == 0)
+        MaxSeedExecUs = std::max(MaxSeedExecUs.load(), Entry->ExecUs);
+    fprintf(stderr, "Resuming with %d queue entries\n", Loaded);
+  }
+
+  if (SeedInputs.empty())
+    SeedInputs.push_back("");
+  if (SeedTrees.size() < SeedInputs.size())
+    SeedTrees.resize(SeedInputs.size());
+  if (DictionaryPath.empty())
+  {
+    // Written by the Dictionary pass; fuzz without tokens if it is absent.
+    DictionaryPath = Target + ".dict";
+    readDictionary(Dictionary, DictionaryPath);
+  }
+  else if (readDictionary(Dictionary, DictionaryPath))
+  {
+    fprintf(stderr, "Cannot read dictionary %s\n", DictionaryPath.c_str());
+    return 1;
+  }
+  if (Jobs > 1 || UseCmpLog || UseDirected)
+  {
+    // Workers cannot share Target.cov or a single popen()ed process,
+    // comparison logging runs need their own fork server and distances
+    // are only reported through shared memory.
+    UseForkServer = true;
+    UseSharedMemory = true;
+  }
   fprintf(stderr, "Fuzzing %s...\n\n", Target.c_str());
-  fuzz(Target, OutDir);
 
-  // At the end, dump the scores for all fuzzing functions to a file
-  // Ensure the "failure" directory exists within OutDir
-  std::string failureDir = OutDir + "/failure";
+  Stats.start(OutDir, MutationNames, Resume);
+  Stats.resume(Resumed.ElapsedMs, Resumed.Execs);
+  // --max-execs counts the runs of this invocation.
+  if (MaxExecs)
+    MaxExecs += Resumed.Execs;
+  Output.start(UsePack);
+  struct sigaction Stop = {};
+  Stop.sa_handler = requestStop;
+  sigaction(SIGINT, &Stop, NULL);
+  sigaction(SIGTERM, &Stop, NULL);
+
+  std::vector<std::thread> Workers;
+  for (int i = 0; i < Jobs; ++i)
+  {
+    Workers.emplace_back([=]() {
+      WorkerId = i;
+      // A resumed campaign must not replay the mutations it started with.
+      Rng.seed((RandomSeed + i) ^ (uint32_t)Resumed.Execs);
+      fuzz(Target, OutDir);
+    });
+  }
+  for (auto &Worker : Workers)
+    Worker.join();
+  finishCampaign(OutDir);
   return 0;
 }
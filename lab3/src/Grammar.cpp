@@ -0,0 +1,454 @@
+#include "Grammar.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// Depth and node count a freshly generated (sub)tree may reach before only
+// the shortest alternatives are taken.
+static const int MAX_GENERATION_DEPTH = 24;
+static const int GENERATION_NODE_BUDGET = 1024;
+
+// Mutated trees larger than this are discarded.
+static const int MAX_TREE_NODES = 1 << 14;
+
+/**
+ * @brief The node at preorder Index of Tree, and its depth.
+ */
+static DerivationTree nodeAt(const DerivationTree &Tree, int Index,
+                             int &Depth) {
+  DerivationTree Node = Tree;
+  Depth = 0;
+  while (Index > 0) {
+    --Index;
+    for (auto &Child : Node->Children) {
+      if (Index < Child->Size) {
+        Node = Child;
+        break;
+      }
+      Index -= Child->Size;
+    }
+    ++Depth;
+  }
+  return Node;
+}
+
+/**
+ * @brief A copy of Tree with the node at preorder Index replaced by New.
+ * Only the nodes on the path to it are copied.
+ */
+static DerivationTree replaceAt(const DerivationTree &Tree, int Index,
+                                const DerivationTree &New) {
+  if (Index == 0)
+    return New;
+  auto Copy = std::make_shared<DerivationNode>(*Tree);
+  --Index;
+  for (auto &Child : Copy->Children) {
+    if (Index < Child->Size) {
+      Copy->Size -= Child->Size;
+      Child = replaceAt(Child, Index, New);
+      Copy->Size += Child->Size;
+      break;
+    }
+    Index -= Child->Size;
+  }
+  return Copy;
+}
+
+/**
+ * @brief Append the preorder indices (offset by Base) of the nodes of Tree
+ * expanding Symbol to Out.
+ */
+static void findSymbol(const DerivationTree &Tree, int Symbol, int Base,
+                       std::vector<int> &Out) {
+  if (Tree->Symbol == Symbol)
+    Out.push_back(Base);
+  ++Base;
+  for (auto &Child : Tree->Children) {
+    findSymbol(Child, Symbol, Base, Out);
+    Base += Child->Size;
+  }
+}
+
+/**
+ * @brief Append the alternatives of Tree, in preorder, to Out.
+ */
+static void encodeAlts(const DerivationNode &Node, std::string &Out) {
+  Out += std::to_string(Node.Alt);
+  Out += ' ';
+  for (auto &Child : Node.Children)
+    encodeAlts(*Child, Out);
+}
+
+std::string encodeTree(const DerivationTree &Tree) {
+  std::string Out;
+  encodeAlts(*Tree, Out);
+  return Out;
+}
+
+/**
+ * @brief Read the character at Text[i] into C, resolving a backslash
+ * escape, and advance i past it.
+ *
+ * @return bool false if it is a \x escape without two hex digits.
+ */
+static bool parseChar(const std::string &Text, size_t &i, char &C) {
+  C = Text[i++];
+  if (C != '\\' || i >= Text.size())
+    return true;
+  C = Text[i++];
+  switch (C) {
+  case 'n':
+    C = '\n';
+    return true;
+  case 't':
+    C = '\t';
+    return true;
+  case 'r':
+    C = '\r';
+    return true;
+  case '0':
+    C = '\0';
+    return true;
+  case 'x':
+    if (i + 2 > Text.size() || !isxdigit((unsigned char)Text[i]) ||
+        !isxdigit((unsigned char)Text[i + 1]))
+      return false;
+    C = (char)strtol(Text.substr(i, 2).c_str(), nullptr, 16);
+    i += 2;
+    return true;
+  default:
+    return true;
+  }
+}
+
+int Grammar::symbolIndex(const std::string &Name) {
+  for (size_t i = 0; i < Rules.size(); ++i)
+    if (Rules[i].Name == Name)
+      return i;
+  Rules.push_back(Rule());
+  Rules.back().Name = Name;
+  Defined.push_back(false);
+  return Rules.size() - 1;
+}
+
+int Grammar::parseAlternatives(const std::string &Text, int RuleIdx,
+                               std::string &Error) {
+  std::vector<Item> Alt;
+  size_t i = 0;
+  auto FinishAlt = [&]() {
+    Rules[RuleIdx].Alts.push_back(Alt);
+    Alt.clear();
+  };
+
+  while (i < Text.size()) {
+    char C = Text[i];
+    if (isspace((unsigned char)C)) {
+      ++i;
+    } else if (C == '|') {
+      FinishAlt();
+      ++i;
+    } else if (C == '<') {
+      size_t End = Text.find('>', i);
+      if (End == std::string::npos) {
+        Error = "unterminated nonterminal";
+        return 1;
+      }
+      Alt.push_back({false, symbolIndex(Text.substr(i, End - i + 1)), ""});
+      i = End + 1;
+    } else if (C == '"' || C == '\'') {
+      std::string Terminal;
+      ++i;
+      while (i < Text.size() && Text[i] != C) {
+        char Ch;
+        if (!parseChar(Text, i, Ch)) {
+          Error = "bad \\x escape";
+          return 1;
+        }
+        Terminal += Ch;
+      }
+      if (i >= Text.size()) {
+        Error = "unterminated string";
+        return 1;
+      }
+      ++i;
+      if (!Terminal.empty())
+        Alt.push_back({true, -1, Terminal});
+    } else if (C == '[') {
+      // A character class is a nonterminal with one alternative per
+      // character, shared by every use of the same class.
+      size_t Start = i++;
+      std::string Chars;
+      while (i < Text.size() && Text[i] != ']') {
+        char From, To;
+        if (!parseChar(Text, i, From)) {
+          Error = "bad \\x escape";
+          return 1;
+        }
+        To = From;
+        if (i + 1 < Text.size() && Text[i] == '-' && Text[i + 1] != ']') {
+          ++i;
+          if (!parseChar(Text, i, To)) {
+            Error = "bad \\x escape";
+            return 1;
+          }
+        }
+        for (int Ch = (unsigned char)From; Ch <= (unsigned char)To; ++Ch)
+          if (Chars.find((char)Ch) == std::string::npos)
+            Chars += (char)Ch;
+      }
+      if (i >= Text.size() || Chars.empty()) {
+        Error = "bad character class";
+        return 1;
+      }
+      ++i;
+      std::string Name = Text.substr(Start, i - Start);
+      int Class = symbolIndex(Name);
+      if (!Defined[Class]) {
+        Defined[Class] = true;
+        for (char Ch : Chars)
+          Rules[Class].Alts.push_back({{true, -1, std::string(1, Ch)}});
+      }
+      Alt.push_back({false, Class, ""});
+    } else {
+      Error = std::string("unexpected '") + C + "'";
+      return 1;
+    }
+  }
+  FinishAlt();
+  return 0;
+}
+
+int Grammar::computeDepths(std::string &Error) {
+  for (Rule &R : Rules) {
+    R.MinDepth = INT_MAX;
+    R.AltDepth.assign(R.Alts.size(), INT_MAX);
+  }
+
+  // Iterate to a fixed point: an alternative is one deeper than its
+  // deepest nonterminal.
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Rule &R : Rules) {
+      for (size_t a = 0; a < R.Alts.size(); ++a) {
+        int Depth = 1;
+        for (const Item &I : R.Alts[a]) {
+          if (I.Terminal)
+            continue;
+          int Sub = Rules[I.Symbol].MinDepth;
+          Depth = Sub == INT_MAX ? INT_MAX : std::max(Depth, Sub + 1);
+          if (Depth == INT_MAX)
+            break;
+        }
+        R.AltDepth[a] = Depth;
+        if (Depth < R.MinDepth) {
+          R.MinDepth = Depth;
+          Changed = true;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < Rules.size(); ++i) {
+    if (!Defined[i]) {
+      Error = Rules[i].Name + " is used but not defined";
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < Rules.size(); ++i) {
+    if (Rules[i].MinDepth == INT_MAX) {
+      Error = Rules[i].Name + " never derives a finite input";
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int Grammar::load(const std::string &Path, std::string &Error) {
+  std::ifstream InFile(Path);
+  if (!InFile) {
+    Error = "cannot read " + Path;
+    return 1;
+  }
+
+  Rules.clear();
+  Defined.clear();
+  int Current = -1;
+  std::string Line;
+  for (int LineNo = 1; std::getline(InFile, Line); ++LineNo) {
+    size_t Start = Line.find_first_not_of(" \t\r");
+    if (Start == std::string::npos || Line[Start] == '#')
+      continue;
+
+    std::string Body;
+    if (Line[Start] == '|' && Current >= 0) {
+      Body = Line.substr(Start + 1);
+    } else {
+      size_t Arrow = Line.find("::=");
+      size_t NameEnd = Line.find('>', Start);
+      if (Line[Start] != '<' || Arrow == std::string::npos ||
+          NameEnd == std::string::npos || NameEnd > Arrow) {
+        Error = "line " + std::to_string(LineNo) + ": expected <name> ::=";
+        return 1;
+      }
+      Current = symbolIndex(Line.substr(Start, NameEnd - Start + 1));
+      Defined[Current] = true;
+      Body = Line.substr(Arrow + 3);
+    }
+    if (parseAlternatives(Body, Current, Error)) {
+      Error = "line " + std::to_string(LineNo) + ": " + Error;
+      return 1;
+    }
+  }
+
+  if (Rules.empty()) {
+    Error = Path + " has no rules";
+    return 1;
+  }
+  return computeDepths(Error);
+}
+
+DerivationTree Grammar::generate(int Symbol, int Depth, int &NodeBudget,
+                                 std::mt19937 &Rng) const {
+  const Rule &R = Rules[Symbol];
+  int Alt = std::min_element(R.AltDepth.begin(), R.AltDepth.end()) -
+            R.AltDepth.begin();
+  if (NodeBudget > 0) {
+    std::vector<int> Fitting;
+    for (size_t a = 0; a < R.Alts.size(); ++a)
+      if (R.AltDepth[a] <= Depth)
+        Fitting.push_back(a);
+    if (!Fitting.empty())
+      Alt = Fitting[Rng() % Fitting.size()];
+  }
+  --NodeBudget;
+
+  auto Node = std::make_shared<DerivationNode>();
+  Node->Symbol = Symbol;
+  Node->Alt = Alt;
+  for (const Item &I : R.Alts[Alt]) {
+    if (I.Terminal)
+      continue;
+    Node->Children.push_back(generate(I.Symbol, Depth - 1, NodeBudget, Rng));
+    Node->Size += Node->Children.back()->Size;
+  }
+  return Node;
+}
+
+DerivationTree Grammar::generate(std::mt19937 &Rng) const {
+  int NodeBudget = GENERATION_NODE_BUDGET;
+  return generate(0, MAX_GENERATION_DEPTH, NodeBudget, Rng);
+}
+
+DerivationTree Grammar::regenerate(const DerivationTree &Tree,
+                                   std::mt19937 &Rng) const {
+  int Index = Rng() % Tree->Size;
+  int Depth;
+  DerivationTree Node = nodeAt(Tree, Index, Depth);
+  int NodeBudget = GENERATION_NODE_BUDGET;
+  int Room =
+      std::max(Rules[Node->Symbol].MinDepth, MAX_GENERATION_DEPTH - Depth);
+  return replaceAt(Tree, Index, generate(Node->Symbol, Room, NodeBudget, Rng));
+}
+
+DerivationTree Grammar::splice(const DerivationTree &Tree,
+                               const DerivationTree &Donor,
+                               std::mt19937 &Rng) const {
+  int Index = Rng() % Tree->Size;
+  int Depth;
+  DerivationTree Node = nodeAt(Tree, Index, Depth);
+  std::vector<int> Matches;
+  findSymbol(Donor, Node->Symbol, 0, Matches);
+  if (Matches.empty())
+    return regenerate(Tree, Rng);
+  DerivationTree Graft = nodeAt(Donor, Matches[Rng() % Matches.size()], Depth);
+  return replaceAt(Tree, Index, Graft);
+}
+
+DerivationTree Grammar::recurse(const DerivationTree &Tree,
+                                std::mt19937 &Rng) const {
+  int Index = Rng() % Tree->Size;
+  int Depth;
+  DerivationTree Node = nodeAt(Tree, Index, Depth);
+  std::vector<int> Matches;
+  findSymbol(Node, Node->Symbol, 0, Matches);
+  if (Matches.size() < 2)
+    return regenerate(Tree, Rng);
+  // Put a copy of the node where its recursion ends, repeating the part of
+  // the input in between (e.g. one more nesting level or list item).
+  int Inner = Matches[1 + Rng() % (Matches.size() - 1)];
+  return replaceAt(Tree, Index, replaceAt(Node, Inner, Node));
+}
+
+DerivationTree Grammar::mutate(const DerivationTree &Tree,
+                               const DerivationTree &Donor,
+                               std::mt19937 &Rng) const {
+  DerivationTree Mutated;
+  switch (Rng() % 3) {
+  case 0:
+    Mutated = regenerate(Tree, Rng);
+    break;
+  case 1:
+    Mutated = Donor ? splice(Tree, Donor, Rng) : regenerate(Tree, Rng);
+    break;
+  default:
+    Mutated = recurse(Tree, Rng);
+    break;
+  }
+  return Mutated->Size > MAX_TREE_NODES ? Tree : Mutated;
+}
+
+bool Grammar::serialize(const DerivationNode &Node, std::string &Out,
+                        size_t MaxLen) const {
+  size_t Child = 0;
+  for (const Item &I : Rules[Node.Symbol].Alts[Node.Alt]) {
+    if (I.Terminal)
+      Out += I.Text;
+    else if (!serialize(*Node.Children[Child++], Out, MaxLen))
+      return false;
+    if (Out.size() > MaxLen)
+      return false;
+  }
+  return true;
+}
+
+bool Grammar::serialize(const DerivationTree &Tree, std::string &Out,
+                        size_t MaxLen) const {
+  Out.clear();
+  return serialize(*Tree, Out, MaxLen);
+}
+
+DerivationTree Grammar::decode(int Symbol, const std::vector<int> &Alts,
+                               size_t &Next) const {
+  if (Next >= Alts.size() || Alts[Next] < 0 ||
+      (size_t)Alts[Next] >= Rules[Symbol].Alts.size())
+    return nullptr;
+  auto Node = std::make_shared<DerivationNode>();
+  Node->Symbol = Symbol;
+  Node->Alt = Alts[Next++];
+  for (const Item &I : Rules[Symbol].Alts[Node->Alt]) {
+    if (I.Terminal)
+      continue;
+    DerivationTree Child = decode(I.Symbol, Alts, Next);
+    if (!Child)
+      return nullptr;
+    Node->Children.push_back(Child);
+    Node->Size += Child->Size;
+  }
+  return Node;
+}
+
+DerivationTree Grammar::decode(const std::string &Text) const {
+  std::istringstream In(Text);
+  std::vector<int> Alts;
+  int Alt;
+  while (In >> Alt)
+    Alts.push_back(Alt);
+  size_t Next = 0;
+  DerivationTree Tree = Rules.empty() ? nullptr : decode(0, Alts, Next);
+  return Next == Alts.size() ? Tree : nullptr;
+}
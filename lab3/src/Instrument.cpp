@@ -1,11 +1,361 @@
 #include "Instrument.h"
 
+#include <climits>
+#include <deque>
+#include <map>
+#include <queue>
+#include <random>
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "Runtime.h"
+
 using namespace llvm;
 
 namespace instrument {
 
 static const char *SANITIZE_FUNCTION_NAME = "__sanitize__";
 static const char *COVERAGE_FUNCTION_NAME = "__coverage__";
+static const char *BLOCK_COVERAGE_FUNCTION_NAME = "__coverage_block__";
+static const char *CMPLOG_FUNCTION_NAME = "__cmplog__";
+static const char *DISTANCE_FUNCTION_NAME = "__distance__";
+static const char *COVERAGE_MAP_NAME = "__coverage_map__";
+static const char *PREV_LOC_NAME = "__prev_loc__";
+static const char *INIT_FUNCTION_NAME = "__fuzzer_init";
+static const char *DEFERRED_FLAG_NAME = "__fuzzer_deferred__";
+
+static cl::opt<bool>
+    EdgeCoverage("edge-coverage",
+                 cl::desc("Record control-flow edges in the shared coverage "
+                          "map instead of calling __coverage__ per "
+                          "statement (needs the fuzzer's -s)"));
+
+static cl::opt<bool>
+    BlockCoverage("block-coverage",
+                  cl::desc("Report the statements of each straight-line "
+                           "region with one __coverage_block__ call instead "
+                           "of one __coverage__ call per statement"));
+
+static cl::opt<bool>
+    CmpLog("cmplog",
+           cl::desc("Pass the operands of every integer comparison to "
+                    "__cmplog__ for the fuzzer's comparison solving (-c)"));
+
+static cl::opt<bool>
+    Directed("directed",
+             cl::desc("Report the distance of every basic block to the "
+                      "nearest division to __distance__ for the fuzzer's "
+                      "directed mode (-D)"));
+
+static cl::opt<bool>
+    DeferInit("defer-init",
+              cl::desc("Start the fork server in main() right before it "
+                       "first reads its input instead of before main(), so "
+                       "runs skip the startup code"));
+
+// Library functions that read the input, before which -defer-init starts the
+// fork server.
+static const char *INPUT_FUNCTION_NAMES[] = {
+    "read",     "fread",          "fgets",  "gets",
+    "getchar",  "getc",           "fgetc",  "_IO_getc",
+    "scanf",    "__isoc99_scanf", "fscanf", "__isoc99_fscanf",
+    "getline",  "getdelim"};
+
+// Distance of a block calling a function per call-graph hop from that
+// function to a division, as in AFLGo.
+static const unsigned CALL_DISTANCE_FACTOR = 10;
+
+// Distances of the module's blocks computed for -directed; blocks that
+// cannot reach a division are absent.
+static std::map<const BasicBlock *, unsigned> BlockDistances;
+
+// Source of the compile-time basic block ids used by -edge-coverage.
+static std::mt19937 BlockIds;
+
+// Source of the compile-time comparison ids used by -cmplog.
+static std::mt19937 CmpIds;
+
+/**
+ * A -block-coverage probe: the (line, col) pairs of a run of instructions
+ * that always execute together, reported by one call before InsertPt.
+ */
+struct CoverageProbe {
+  Instruction *InsertPt;
+  std::vector<int> Locs; // line, col, line, col, ...
+};
+
+/**
+ * Split F into probe regions. A region starts at a block entry and ends
+ * after the next call, which may not return, or around a division, which
+ * may trap and whose __sanitize__ check may exit. A block whose only
+ * predecessor has it as only successor continues the predecessor's open
+ * region instead of getting its own probe. Each region keeps one (line,
+ * col) pair per instruction, so the runtime reports exactly what
+ * per-statement probes would have.
+ */
+void collectProbes(Function &F, std::vector<CoverageProbe> &Probes) {
+  std::map<BasicBlock *, int> OpenAtEnd;
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT) {
+    int Open = -1;
+    BasicBlock *Pred = BB->getSinglePredecessor();
+    if (Pred && Pred != BB && Pred->getSingleSuccessor() == BB &&
+        OpenAtEnd.count(Pred))
+      Open = OpenAtEnd[Pred];
+
+    for (Instruction &I : *BB) {
+      if (isa<PHINode>(I))
+        continue;
+      const auto DebugLoc = I.getDebugLoc();
+      if (!DebugLoc)
+        continue;
+      if (I.getOpcode() == Instruction::SDiv ||
+          I.getOpcode() == Instruction::UDiv)
+        Open = -1;
+      if (Open < 0) {
+        Probes.push_back({&I, {}});
+        Open = Probes.size() - 1;
+      }
+      Probes[Open].Locs.push_back(DebugLoc.getLine());
+      Probes[Open].Locs.push_back(DebugLoc.getCol());
+      if (((isa<CallInst>(I) || isa<InvokeInst>(I)) &&
+           !isa<IntrinsicInst>(I)) ||
+          I.getOpcode() == Instruction::SDiv ||
+          I.getOpcode() == Instruction::UDiv ||
+          I.getOpcode() == Instruction::SRem ||
+          I.getOpcode() == Instruction::URem)
+        Open = -1;
+    }
+    if (Open >= 0)
+      OpenAtEnd[BB] = Open;
+  }
+}
+
+void instrumentProbe(Module *M, CoverageProbe &Probe) {
+  LLVMContext &Context = M->getContext();
+  Type *Int32Type = Type::getInt32Ty(Context);
+
+  auto *Table = ConstantDataArray::get(Context, Probe.Locs);
+  auto *TableVar =
+      new GlobalVariable(*M, Table->getType(), true,
+                         GlobalValue::PrivateLinkage, Table, "__probe_locs__");
+  auto *TablePtr =
+      ConstantExpr::getPointerCast(TableVar, Type::getInt32PtrTy(Context));
+  auto *Count = ConstantInt::get(Int32Type, Probe.Locs.size() / 2);
+  std::vector<Value *> Args = {TablePtr, Count};
+
+  auto *Fun = M->getFunction(BLOCK_COVERAGE_FUNCTION_NAME);
+  CallInst::Create(Fun, Args, "", Probe.InsertPt);
+}
+
+static bool isDivision(const Instruction &I) {
+  return I.getOpcode() == Instruction::SDiv ||
+         I.getOpcode() == Instruction::UDiv;
+}
+
+/**
+ * Compute the distance of every basic block of M to the divisions, the
+ * sites __sanitize__ checks, in the manner of AFLGo:
+ *
+ * - A function's distance is the number of call-graph hops to a function
+ *   containing a division.
+ * - A block containing a division is at 0. A block calling functions is at
+ *   CALL_DISTANCE_FACTOR times one more than the nearest callee's distance.
+ * - Any other block is one more than its nearest successor in the CFG.
+ *
+ * AFLGo averages over targets with harmonic means; the nearest one is used
+ * here, so every distance is a shortest path.
+ */
+void computeDistances(Module &M,
+                      std::map<const BasicBlock *, unsigned> &Distances) {
+  std::map<const Function *, std::vector<const Function *>> Callers;
+  std::map<const Function *, unsigned> FunctionDistances;
+  std::deque<const Function *> Work;
+  for (Function &F : M) {
+    bool HasDivision = false;
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      HasDivision |= isDivision(*I);
+      if (auto *Call = dyn_cast<CallInst>(&*I))
+        if (Function *Callee = Call->getCalledFunction())
+          Callers[Callee].push_back(&F);
+    }
+    if (HasDivision) {
+      FunctionDistances[&F] = 0;
+      Work.push_back(&F);
+    }
+  }
+  while (!Work.empty()) {
+    const Function *F = Work.front();
+    Work.pop_front();
+    for (const Function *Caller : Callers[F]) {
+      if (FunctionDistances.count(Caller))
+        continue;
+      FunctionDistances[Caller] = FunctionDistances[F] + 1;
+      Work.push_back(Caller);
+    }
+  }
+
+  // Per function, Dijkstra from the blocks with a distance of their own
+  // back through the CFG.
+  typedef std::pair<unsigned, const BasicBlock *> QueueItem;
+  for (Function &F : M) {
+    std::priority_queue<QueueItem, std::vector<QueueItem>,
+                        std::greater<QueueItem>>
+        Queue;
+    for (BasicBlock &BB : F) {
+      unsigned Distance = UINT_MAX;
+      for (Instruction &I : BB) {
+        if (isDivision(I)) {
+          Distance = 0;
+          break;
+        }
+        auto *Call = dyn_cast<CallInst>(&I);
+        Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+        auto It = FunctionDistances.find(Callee);
+        if (Callee && It != FunctionDistances.end())
+          Distance =
+              std::min(Distance, CALL_DISTANCE_FACTOR * (It->second + 1));
+      }
+      if (Distance != UINT_MAX)
+        Queue.push({Distance, &BB});
+    }
+    while (!Queue.empty()) {
+      QueueItem Item = Queue.top();
+      Queue.pop();
+      if (Distances.count(Item.second))
+        continue;
+      Distances[Item.second] = Item.first;
+      for (const BasicBlock *Pred : predecessors(Item.second))
+        if (!Distances.count(Pred))
+          Queue.push({Item.first + 1, Pred});
+    }
+  }
+}
+
+/**
+ * Report the distance of BB when it is entered:
+ *
+ *   __distance__(Distance);
+ */
+void instrumentDistance(Module *M, BasicBlock &BB, unsigned Distance) {
+  IRBuilder<> IRB(&*BB.getFirstInsertionPt());
+  auto *Fun = M->getFunction(DISTANCE_FUNCTION_NAME);
+  IRB.CreateCall(Fun, {IRB.getInt32(Distance)});
+}
+
+/**
+ * @brief Whether I calls one of INPUT_FUNCTION_NAMES.
+ */
+static bool isInputCall(const Instruction &I) {
+  auto *Call = dyn_cast<CallInst>(&I);
+  Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+  if (!Callee)
+    return false;
+  for (const char *Name : INPUT_FUNCTION_NAMES)
+    if (Callee->getName() == Name)
+      return true;
+  return false;
+}
+
+/**
+ * Start the fork server before every call in main that reads the input;
+ * only the first one executed takes effect:
+ *
+ *   int __fuzzer_deferred__ = 1;
+ *   ...
+ *   __fuzzer_init();
+ *   fgets(...);
+ *
+ * Nothing is deferred when main reads no input itself, e.g. only through
+ * its callees: the fork server then starts before main() as usual.
+ */
+void instrumentDeferredInit(Module *M, Function &Main) {
+  std::vector<Instruction *> Reads;
+  for (inst_iterator I = inst_begin(Main), E = inst_end(Main); I != E; ++I)
+    if (isInputCall(*I))
+      Reads.push_back(&*I);
+  if (Reads.empty())
+    return;
+
+  auto *Fun = M->getFunction(INIT_FUNCTION_NAME);
+  for (Instruction *Read : Reads)
+    CallInst::Create(Fun, {}, "", Read);
+
+  Type *Int32Type = Type::getInt32Ty(M->getContext());
+  if (!M->getNamedGlobal(DEFERRED_FLAG_NAME))
+    new GlobalVariable(*M, Int32Type, false, GlobalValue::ExternalLinkage,
+                       ConstantInt::get(Int32Type, 1), DEFERRED_FLAG_NAME);
+}
+
+/**
+ * Update the coverage map slot of the edge from the previous block into BB:
+ *
+ *   map[CurLoc ^ __prev_loc__]++;
+ *   __prev_loc__ = CurLoc >> 1;
+ *
+ * Shifting the previous id keeps A->B and B->A, and tight self loops,
+ * apart.
+ */
+void instrumentEdge(Module *M, BasicBlock &BB, unsigned CurLoc) {
+  LLVMContext &Context = M->getContext();
+  Type *Int8Type = Type::getInt8Ty(Context);
+  Type *Int32Type = Type::getInt32Ty(Context);
+  Type *Int8PtrType = Type::getInt8PtrTy(Context);
+
+  auto *MapPtr = M->getOrInsertGlobal(COVERAGE_MAP_NAME, Int8PtrType);
+  auto *PrevLoc = M->getOrInsertGlobal(PREV_LOC_NAME, Int32Type);
+
+  IRBuilder<> IRB(&*BB.getFirstInsertionPt());
+  Value *Prev = IRB.CreateLoad(Int32Type, PrevLoc);
+  Value *Index = IRB.CreateXor(Prev, ConstantInt::get(Int32Type, CurLoc));
+  Value *Map = IRB.CreateLoad(Int8PtrType, MapPtr);
+  Value *Slot = IRB.CreateGEP(Int8Type, Map,
+                              IRB.CreateZExt(Index, IRB.getInt64Ty()));
+  Value *Counter = IRB.CreateLoad(Int8Type, Slot);
+  // Saturate at 255 like __coverage__ instead of wrapping back to 0.
+  Value *Saturated = IRB.CreateICmpEQ(Counter, ConstantInt::get(Int8Type, 255));
+  Value *Incr = IRB.CreateAdd(Counter, ConstantInt::get(Int8Type, 1));
+  IRB.CreateStore(IRB.CreateSelect(Saturated, Counter, Incr), Slot);
+  IRB.CreateStore(ConstantInt::get(Int32Type, CurLoc >> 1), PrevLoc);
+}
+
+/**
+ * Log the operands of Cmp, widened to 64 bits, before it runs:
+ *
+ *   __cmplog__(a, b, sizeof(a), Id);
+ */
+void instrumentCmp(Module *M, ICmpInst &Cmp, unsigned Id) {
+  LLVMContext &Context = M->getContext();
+  Type *Int32Type = Type::getInt32Ty(Context);
+  Type *Int64Type = Type::getInt64Ty(Context);
+  unsigned Bits = Cmp.getOperand(0)->getType()->getIntegerBitWidth();
+
+  IRBuilder<> IRB(&Cmp);
+  Value *A = IRB.CreateZExt(Cmp.getOperand(0), Int64Type);
+  Value *B = IRB.CreateZExt(Cmp.getOperand(1), Int64Type);
+  std::vector<Value *> Args = {A, B, ConstantInt::get(Int32Type, Bits / 8),
+                               ConstantInt::get(Int32Type, Id)};
+
+  auto *Fun = M->getFunction(CMPLOG_FUNCTION_NAME);
+  IRB.CreateCall(Fun, Args);
+}
+
+/**
+ * @brief Whether Cmp compares integers worth logging: 8 to 64 bits wide
+ * and not both constant.
+ */
+static bool isLoggableCmp(ICmpInst &Cmp) {
+  Type *Ty = Cmp.getOperand(0)->getType();
+  if (!Ty->isIntegerTy())
+    return false;
+  unsigned Bits = Ty->getIntegerBitWidth();
+  return Bits >= 8 && Bits <= 64 && Bits % 8 == 0 &&
+         !(isa<Constant>(Cmp.getOperand(0)) &&
+           isa<Constant>(Cmp.getOperand(1)));
+}
 
 void instrumentCoverage(Module *M, Instruction &I, int Line, int Col) {
   auto &Context = M->getContext();
@@ -32,6 +382,16 @@ void instrumentSanitize(Module *M, Instruction &I, int Line, int Col) {
   CallInst::Create(Fun, Args, "", &I);
 }
 
+bool Instrument::doInitialization(Module &M) {
+  // Derive block ids from the module so rebuilding gives the same map.
+  BlockIds.seed(std::hash<std::string>()(M.getModuleIdentifier()));
+  CmpIds.seed(std::hash<std::string>()(M.getModuleIdentifier()));
+  BlockDistances.clear();
+  if (Directed)
+    computeDistances(M, BlockDistances);
+  return false;
+}
+
 bool Instrument::runOnFunction(Function &F) {
   LLVMContext &Context = F.getContext();
   Module *M = F.getParent();
@@ -43,6 +403,27 @@ bool Instrument::runOnFunction(Function &F) {
                          Int32Type);
   M->getOrInsertFunction(SANITIZE_FUNCTION_NAME, VoidType, Int32Type, Int32Type,
                          Int32Type);
+  M->getOrInsertFunction(BLOCK_COVERAGE_FUNCTION_NAME, VoidType,
+                         Type::getInt32PtrTy(Context), Int32Type);
+  M->getOrInsertFunction(CMPLOG_FUNCTION_NAME, VoidType,
+                         Type::getInt64Ty(Context), Type::getInt64Ty(Context),
+                         Int32Type, Int32Type);
+  M->getOrInsertFunction(DISTANCE_FUNCTION_NAME, VoidType, Int32Type);
+  M->getOrInsertFunction(INIT_FUNCTION_NAME, VoidType);
+
+  // Regions are computed before any call is inserted.
+  std::vector<CoverageProbe> Probes;
+  if (BlockCoverage && !EdgeCoverage)
+    collectProbes(F, Probes);
+
+  // Only the program's own comparisons, not those -edge-coverage adds.
+  std::vector<ICmpInst *> Cmps;
+  if (CmpLog) {
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+      if (auto *Cmp = dyn_cast<ICmpInst>(&*I))
+        if (isLoggableCmp(*Cmp))
+          Cmps.push_back(Cmp);
+  }
 
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
     if (I->getOpcode() == Instruction::PHI) {
@@ -54,12 +435,34 @@ bool Instrument::runOnFunction(Function &F) {
     }
     int Line = DebugLoc.getLine();
     int Col = DebugLoc.getCol();
-    if (I->getOpcode() == Instruction::SDiv ||
-        I->getOpcode() == Instruction::UDiv) {
+    if (isDivision(*I)) {
       instrumentSanitize(M, *I, Line, Col);
     }
-    instrumentCoverage(M, *I, Line, Col);
+    if (!EdgeCoverage && !BlockCoverage)
+      instrumentCoverage(M, *I, Line, Col);
+  }
+
+  for (auto &Probe : Probes)
+    instrumentProbe(M, Probe);
+
+  for (ICmpInst *Cmp : Cmps)
+    instrumentCmp(M, *Cmp, CmpIds() % CMP_MAP_SIZE);
+
+  if (EdgeCoverage) {
+    for (BasicBlock &BB : F)
+      instrumentEdge(M, BB, BlockIds() % MAP_SIZE);
   }
+
+  if (Directed) {
+    for (BasicBlock &BB : F) {
+      auto It = BlockDistances.find(&BB);
+      if (It != BlockDistances.end())
+        instrumentDistance(M, BB, It->second);
+    }
+  }
+
+  if (DeferInit && F.getName() == "main")
+    instrumentDeferredInit(M, F);
   return true;
 }
 
@@ -0,0 +1,153 @@
+#include "Minimize.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Executor.h"
+#include "Runtime.h"
+#include "Utils.h"
+
+/**
+ * Result of replaying one corpus entry.
+ *
+ * @param Name   file name inside the input directory.
+ * @param Size   input length in bytes.
+ * @param ExecUs execution time in microseconds.
+ * @param Slots  coverage map slots the input reached.
+ * @param TimedOut was the input killed for exceeding the timeout?
+ */
+struct CorpusEntry {
+  std::string Name;
+  size_t Size = 0;
+  long ExecUs = 0;
+  std::vector<unsigned> Slots;
+  bool TimedOut = false;
+};
+
+static void replayEntries(std::string Target, std::string InDir,
+                          std::string OutDir, int WorkerId, int TimeoutMs,
+                          size_t MemLimitMb,
+                          std::vector<CorpusEntry> &Entries,
+                          std::atomic<size_t> &Next) {
+  ForkServer Server;
+  Server.MemLimitMb = MemLimitMb;
+  unsigned char *TraceBits = setupSharedMemory(Server.ShmId);
+  std::string InputPath = OutDir + "/.cmin_input" + std::to_string(WorkerId);
+  if (startForkServer(Server, Target, InputPath)) {
+    fprintf(stderr, "%s did not start a fork server, is it linked against "
+                    "libruntime?\n",
+            Target.c_str());
+    exit(1);
+  }
+
+  size_t Idx;
+  while ((Idx = Next.fetch_add(1)) < Entries.size()) {
+    CorpusEntry &Entry = Entries[Idx];
+    std::string Path = InDir + "/" + Entry.Name;
+    std::string Input = readOneFile(Path);
+
+    std::fill(TraceBits, TraceBits + MAP_SIZE, 0);
+    auto Start = std::chrono::steady_clock::now();
+    int Status = runForkServer(Server, Input, TimeoutMs);
+    auto End = std::chrono::steady_clock::now();
+
+    Entry.Size = Input.size();
+    // A hang's partial coverage is not worth keeping it for.
+    if (Status == EXEC_TIMEOUT) {
+      Entry.TimedOut = true;
+      continue;
+    }
+    Entry.ExecUs =
+        std::chrono::duration_cast<std::chrono::microseconds>(End - Start)
+            .count();
+    for (unsigned Slot = 0; Slot < MAP_SIZE; ++Slot)
+      if (TraceBits[Slot])
+        Entry.Slots.push_back(Slot);
+  }
+  stopForkServer(Server);
+}
+
+int minimizeCorpus(std::string &Target, std::string &InDir,
+                   std::string &OutDir, int Jobs, int TimeoutMs,
+                   size_t MemLimitMb) {
+  std::vector<CorpusEntry> Entries;
+  DIR *Directory = opendir(InDir.c_str());
+  if (!Directory)
+    return 1;
+  struct dirent *Ent;
+  while ((Ent = readdir(Directory)) != NULL) {
+    if (Ent->d_type == DT_REG) {
+      Entries.emplace_back();
+      Entries.back().Name = Ent->d_name;
+    }
+  }
+  closedir(Directory);
+
+  std::atomic<size_t> Next(0);
+  std::vector<std::thread> Workers;
+  for (int i = 0; i < Jobs; ++i)
+    Workers.emplace_back(replayEntries, Target, InDir, OutDir, i, TimeoutMs,
+                         MemLimitMb, std::ref(Entries), std::ref(Next));
+  for (auto &Worker : Workers)
+    Worker.join();
+
+  // Best (smallest and fastest) entry reaching each slot, and how many
+  // entries reach it at all.
+  std::vector<int> Best(MAP_SIZE, -1);
+  std::vector<int> Hits(MAP_SIZE, 0);
+  auto Cost = [&](int Idx) {
+    return (double)std::max<size_t>(Entries[Idx].Size, 1) *
+           std::max<long>(Entries[Idx].ExecUs, 1);
+  };
+  for (int i = 0; i < (int)Entries.size(); ++i) {
+    for (unsigned Slot : Entries[i].Slots) {
+      ++Hits[Slot];
+      if (Best[Slot] < 0 || Cost(i) < Cost(Best[Slot]))
+        Best[Slot] = i;
+    }
+  }
+
+  // Rare slots first: they leave the least choice of entries.
+  std::vector<unsigned> Slots;
+  for (unsigned Slot = 0; Slot < MAP_SIZE; ++Slot)
+    if (Hits[Slot])
+      Slots.push_back(Slot);
+  std::sort(Slots.begin(), Slots.end(),
+            [&](unsigned A, unsigned B) { return Hits[A] < Hits[B]; });
+
+  std::vector<bool> Covered(MAP_SIZE, false);
+  std::vector<bool> Keep(Entries.size(), false);
+  int Kept = 0;
+  for (unsigned Slot : Slots) {
+    if (Covered[Slot])
+      continue;
+    int Idx = Best[Slot];
+    Keep[Idx] = true;
+    ++Kept;
+    for (unsigned S : Entries[Idx].Slots)
+      Covered[S] = true;
+  }
+
+  for (size_t i = 0; i < Entries.size(); ++i) {
+    if (!Keep[i])
+      continue;
+    std::string From = InDir + "/" + Entries[i].Name;
+    std::string To = OutDir + "/" + Entries[i].Name;
+    std::string Input = readOneFile(From);
+    std::ofstream OutFile(To, std::ios::binary);
+    OutFile << Input;
+  }
+
+  fprintf(stderr, "Kept %d of %zu inputs covering %zu map slots\n", Kept,
+          Entries.size(), Slots.size());
+  int TimedOut = std::count_if(
+      Entries.begin(), Entries.end(),
+      [](const CorpusEntry &Entry) { return Entry.TimedOut; });
+  if (TimedOut)
+    fprintf(stderr, "Dropped %d inputs that timed out\n", TimedOut);
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "Output.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+OutputWriter Output;
+
+void OutputWriter::start(bool Pack) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (Running)
+    return;
+  Packed = Pack;
+  Stopping = false;
+  Running = true;
+  Thread = std::thread([this]() { run(); });
+}
+
+void OutputWriter::write(const std::string &Path, const std::string &Data) {
+  std::unique_lock<std::mutex> Guard(Lock);
+  if (!Running) {
+    Guard.unlock();
+    std::lock_guard<std::mutex> WriteGuard(WriteLock);
+    writeRecord({Path, Data});
+    return;
+  }
+  NotFull.wait(Guard, [this]() { return Pending.size() < Capacity; });
+  Pending.push_back({Path, Data});
+  NotEmpty.notify_one();
+}
+
+void OutputWriter::stop() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Running)
+      return;
+    Stopping = true;
+  }
+  NotEmpty.notify_one();
+  Thread.join();
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  Running = false;
+  std::lock_guard<std::mutex> WriteGuard(WriteLock);
+  for (auto &Entry : Packs) {
+    fclose(Entry.second.Data);
+    fclose(Entry.second.Index);
+  }
+  Packs.clear();
+}
+
+void OutputWriter::run() {
+  std::vector<Record> Batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> Guard(Lock);
+      NotEmpty.wait(Guard, [this]() { return Stopping || !Pending.empty(); });
+      if (Pending.empty())
+        return;
+      Batch.assign(std::make_move_iterator(Pending.begin()),
+                   std::make_move_iterator(Pending.end()));
+      Pending.clear();
+    }
+    NotFull.notify_all();
+
+    std::lock_guard<std::mutex> WriteGuard(WriteLock);
+    for (const Record &R : Batch)
+      writeRecord(R);
+    for (auto &Entry : Packs) {
+      fflush(Entry.second.Data);
+      fflush(Entry.second.Index);
+    }
+    Batch.clear();
+  }
+}
+
+void OutputWriter::writeRecord(const Record &R) {
+  if (Packed) {
+    writePacked(R);
+    return;
+  }
+  std::ofstream OutFile(R.Path, std::ios::binary | std::ios::trunc);
+  OutFile << R.Data;
+}
+
+static void writeLength(uint32_t Length, FILE *F) {
+  unsigned char Bytes[4];
+  for (int i = 0; i < 4; ++i)
+    Bytes[i] = Length >> (8 * i);
+  fwrite(Bytes, 1, 4, F);
+}
+
+void OutputWriter::writePacked(const Record &R) {
+  size_t Slash = R.Path.rfind('/');
+  std::string Dir = Slash == std::string::npos ? "." : R.Path.substr(0, Slash);
+  std::string Name =
+      Slash == std::string::npos ? R.Path : R.Path.substr(Slash + 1);
+
+  auto It = Packs.find(Dir);
+  if (It == Packs.end()) {
+    PackFiles Files;
+    Files.Data = fopen((Dir + ".pack").c_str(), "ab");
+    Files.Index = fopen((Dir + ".pack.idx").c_str(), "a");
+    if (!Files.Data || !Files.Index) {
+      fprintf(stderr, "Cannot open %s.pack, dropping %s\n", Dir.c_str(),
+              Name.c_str());
+      if (Files.Data)
+        fclose(Files.Data);
+      if (Files.Index)
+        fclose(Files.Index);
+      return;
+    }
+    fseek(Files.Data, 0, SEEK_END);
+    Files.Offset = ftell(Files.Data);
+    It = Packs.emplace(Dir, Files).first;
+  }
+
+  PackFiles &Files = It->second;
+  writeLength(Name.size(), Files.Data);
+  fwrite(Name.data(), 1, Name.size(), Files.Data);
+  writeLength(R.Data.size(), Files.Data);
+  fwrite(R.Data.data(), 1, R.Data.size(), Files.Data);
+  Files.Offset += 8 + Name.size();
+  fprintf(Files.Index, "%s %llu %zu\n", Name.c_str(),
+          (unsigned long long)Files.Offset, R.Data.size());
+  Files.Offset += R.Data.size();
+}
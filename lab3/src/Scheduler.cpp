@@ -0,0 +1,178 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// Energy of an average entry on its first pick, and the cap on any pick.
+static const int BASE_ENERGY = 16;
+static const int MAX_ENERGY = 1024;
+
+// Picks after which an entry's energy stops doubling.
+static const int MAX_PICK_DOUBLINGS = 6;
+
+// Execution counts per path, indexed by the low bits of the path hash.
+static const int PATH_FREQ_SIZE = 1 << 20;
+static std::atomic<uint32_t> PathFreq[PATH_FREQ_SIZE];
+
+void AliasTable::build(const std::vector<double> &Weights) {
+  size_t N = Weights.size();
+  Prob.assign(N, 0);
+  Alias.assign(N, 0);
+  if (N == 0)
+    return;
+
+  double Sum = 0;
+  for (double W : Weights)
+    Sum += W;
+
+  std::vector<double> Scaled(N);
+  std::vector<uint32_t> Small, Large;
+  for (size_t i = 0; i < N; ++i) {
+    Scaled[i] = Sum > 0 ? Weights[i] * N / Sum : 1;
+    (Scaled[i] < 1 ? Small : Large).push_back(i);
+  }
+  while (!Small.empty() && !Large.empty()) {
+    uint32_t S = Small.back(), L = Large.back();
+    Small.pop_back();
+    Prob[S] = Scaled[S];
+    Alias[S] = L;
+    Scaled[L] -= 1 - Scaled[S];
+    if (Scaled[L] < 1) {
+      Large.pop_back();
+      Small.push_back(L);
+    }
+  }
+  // Leftovers are 1 up to rounding.
+  for (uint32_t i : Small)
+    Prob[i] = 1;
+  for (uint32_t i : Large)
+    Prob[i] = 1;
+}
+
+size_t AliasTable::sample(std::mt19937 &Rng) const {
+  size_t i = Rng() % Prob.size();
+  double Coin = std::generate_canonical<double, 32>(Rng);
+  return Coin < Prob[i] ? i : Alias[i];
+}
+
+void recordPath(uint32_t PathHash) {
+  PathFreq[PathHash % PATH_FREQ_SIZE].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t pathFrequency(uint32_t PathHash) {
+  return PathFreq[PathHash % PATH_FREQ_SIZE].load(std::memory_order_relaxed);
+}
+
+void forEachPathFrequency(
+    const std::function<void(uint32_t Slot, uint32_t Count)> &Fn) {
+  for (uint32_t i = 0; i < PATH_FREQ_SIZE; ++i) {
+    uint32_t Count = PathFreq[i].load(std::memory_order_relaxed);
+    if (Count)
+      Fn(i, Count);
+  }
+}
+
+void setPathFrequency(uint32_t Slot, uint32_t Count) {
+  PathFreq[Slot % PATH_FREQ_SIZE].store(Count, std::memory_order_relaxed);
+}
+
+ScheduleStats computeStats(std::vector<std::shared_ptr<QueueEntry>> &Entries) {
+  ScheduleStats Stats;
+  if (Entries.empty())
+    return Stats;
+  double ExecUs = 0, Len = 0, Freq = 0;
+  bool HasDistance = false;
+  for (auto &Entry : Entries) {
+    ExecUs += Entry->ExecUs;
+    Len += Entry->Input.size();
+    Freq += pathFrequency(Entry->PathHash);
+    if (Entry->Distance < 0)
+      continue;
+    if (!HasDistance || Entry->Distance < Stats.MinDistance)
+      Stats.MinDistance = Entry->Distance;
+    if (!HasDistance || Entry->Distance > Stats.MaxDistance)
+      Stats.MaxDistance = Entry->Distance;
+    HasDistance = true;
+  }
+  Stats.AvgExecUs = std::max(1.0, ExecUs / Entries.size());
+  Stats.AvgLen = std::max(1.0, Len / Entries.size());
+  Stats.AvgPathFreq = std::max(1.0, Freq / Entries.size());
+  return Stats;
+}
+
+double calculateScore(const QueueEntry &Entry, const ScheduleStats &Stats) {
+  double Score = 100;
+
+  // Fast entries give more execs per second.
+  double Exec = std::max<long>(Entry.ExecUs, 1);
+  if (Exec * 0.1 > Stats.AvgExecUs)
+    Score = 10;
+  else if (Exec * 0.25 > Stats.AvgExecUs)
+    Score = 25;
+  else if (Exec * 0.5 > Stats.AvgExecUs)
+    Score = 50;
+  else if (Exec * 0.75 > Stats.AvgExecUs)
+    Score = 75;
+  else if (Exec * 4 < Stats.AvgExecUs)
+    Score = 300;
+  else if (Exec * 3 < Stats.AvgExecUs)
+    Score = 200;
+  else if (Exec * 2 < Stats.AvgExecUs)
+    Score = 150;
+
+  // Short entries are cheaper to pipe in and mutations hit more of them.
+  double Len = std::max<size_t>(Entry.Input.size(), 1);
+  if (Len * 4 < Stats.AvgLen)
+    Score *= 2;
+  else if (Len * 2 < Stats.AvgLen)
+    Score *= 1.5;
+  else if (Len > Stats.AvgLen * 4)
+    Score *= 0.25;
+  else if (Len > Stats.AvgLen * 2)
+    Score *= 0.5;
+
+  // Deep entries were hard to reach and are likely to lead further.
+  if (Entry.Depth >= 26)
+    Score *= 5;
+  else if (Entry.Depth >= 14)
+    Score *= 4;
+  else if (Entry.Depth >= 8)
+    Score *= 3;
+  else if (Entry.Depth >= 4)
+    Score *= 2;
+
+  return Score;
+}
+
+double annealingTemperature(double ElapsedS, double ExploitS) {
+  return std::pow(20.0, -ElapsedS / std::max(ExploitS, 1.0));
+}
+
+double directedFactor(const QueueEntry &Entry, const ScheduleStats &Stats,
+                      double Temperature) {
+  // Normalized distance: 0 for the closest entry, 1 for the farthest and
+  // for entries that reached no block with a distance.
+  double Normalized = 1;
+  if (Entry.Distance >= 0 && Stats.MaxDistance > Stats.MinDistance)
+    Normalized = (Entry.Distance - Stats.MinDistance) /
+                 (Stats.MaxDistance - Stats.MinDistance);
+  else if (Entry.Distance >= 0)
+    Normalized = 0.5;
+  double Power = (1 - Normalized) * (1 - Temperature) + 0.5 * Temperature;
+  return std::pow(2.0, 10 * (Power - 0.5));
+}
+
+double selectionWeight(const QueueEntry &Entry, double Score) {
+  return Score / (1 + std::log2(1.0 + pathFrequency(Entry.PathHash)));
+}
+
+int assignEnergy(const QueueEntry &Entry, double Score,
+                 const ScheduleStats &Stats) {
+  int Picks = std::min(Entry.TimesPicked.load(std::memory_order_relaxed),
+                       MAX_PICK_DOUBLINGS);
+  double Freq = std::max<uint32_t>(pathFrequency(Entry.PathHash), 1);
+  double Energy = BASE_ENERGY * Score / 100 * (1 << Picks) /
+                  std::max(1.0, Freq / Stats.AvgPathFreq);
+  return std::max(1, std::min(MAX_ENERGY, (int)Energy));
+}
@@ -0,0 +1,144 @@
+#include "Stats.h"
+
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <utility>
+
+static const long TICK_MS = 1000;
+
+void StatsReporter::start(const std::string &Dir,
+                          std::vector<std::string> MutatorNames, bool Append) {
+  OutDir = Dir;
+  Names = std::move(MutatorNames);
+  Mutators.reset(new MutatorCounts[Names.size()]);
+  Start = std::chrono::steady_clock::now();
+  StartTime = time(nullptr);
+  NextTickMs = 0;
+
+  if (Append)
+    return;
+  FILE *F = fopen((OutDir + "/plot_data").c_str(), "w");
+  if (F) {
+    fprintf(F, "# unix_time, elapsed_s, execs, execs_per_sec, corpus, "
+               "covered_slots, unique_crashes, crashes, hangs\n");
+    fclose(F);
+  }
+  F = fopen((OutDir + "/crash_times").c_str(), "w");
+  if (F) {
+    fprintf(F, "# elapsed_ms, execs, unique_crashes\n");
+    fclose(F);
+  }
+}
+
+void StatsReporter::resume(long ElapsedMs, long ResumedExecs) {
+  ResumedMs = ElapsedMs;
+  Execs = ResumedExecs;
+  LastTickMs = ElapsedMs;
+  LastTickExecs = ResumedExecs;
+  NextTickMs = ElapsedMs;
+}
+
+long StatsReporter::elapsedMs() const {
+  return ResumedMs + std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - Start)
+                         .count();
+}
+
+void StatsReporter::countMutation(int Index, bool NewCoverage, bool Crashed) {
+  if (Index < 0 || (size_t)Index >= Names.size())
+    return;
+  MutatorCounts &Counts = Mutators[Index];
+  Counts.Runs.fetch_add(1, std::memory_order_relaxed);
+  if (NewCoverage)
+    Counts.Finds.fetch_add(1, std::memory_order_relaxed);
+  if (Crashed)
+    Counts.Crashes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StatsReporter::countCrashFind(int UniqueCrashes) {
+  long NowMs = elapsedMs();
+  LastCrash = NowMs;
+  std::lock_guard<std::mutex> Guard(CrashLock);
+  FILE *F = fopen((OutDir + "/crash_times").c_str(), "a");
+  if (!F)
+    return;
+  fprintf(F, "%ld, %ld, %d\n", NowMs, execs(), UniqueCrashes);
+  fclose(F);
+}
+
+bool StatsReporter::due() {
+  long Now = elapsedMs();
+  long Next = NextTickMs.load(std::memory_order_relaxed);
+  return Now >= Next &&
+         NextTickMs.compare_exchange_strong(Next, Now + TICK_MS);
+}
+
+/**
+ * @brief Seconds since a find at FoundMs, or -1 if there was none.
+ */
+static long secondsSince(long FoundMs, long NowMs) {
+  return FoundMs < 0 ? -1 : (NowMs - FoundMs) / 1000;
+}
+
+void StatsReporter::write(const StatsSample &Sample, bool Final) {
+  std::lock_guard<std::mutex> Guard(WriteLock);
+  long NowMs = elapsedMs();
+  long Total = execs();
+  double Elapsed = NowMs / 1000.0;
+  double Interval = (NowMs - LastTickMs) / 1000.0;
+  double TotalRate = Elapsed > 0 ? Total / Elapsed : 0;
+  double CurrentRate =
+      Interval > 0 ? (Total - LastTickExecs) / Interval : TotalRate;
+  bool Plot = true;
+  if (Final && NowMs - LastTickMs < TICK_MS) {
+    CurrentRate = LastTickRate >= 0 ? LastTickRate : TotalRate;
+    Plot = false;
+  }
+  LastTickExecs = Total;
+  LastTickMs = NowMs;
+  LastTickRate = CurrentRate;
+
+  std::string Path = OutDir + "/fuzzer_stats";
+  std::string TmpPath = Path + ".tmp";
+  FILE *F = fopen(TmpPath.c_str(), "w");
+  if (F) {
+    fprintf(F, "start_time        : %ld\n", (long)StartTime);
+    fprintf(F, "last_update       : %ld\n", (long)time(nullptr));
+    fprintf(F, "fuzzer_pid        : %d\n", (int)getpid());
+    fprintf(F, "run_time          : %ld\n", NowMs / 1000);
+    fprintf(F, "execs_done        : %ld\n", Total);
+    fprintf(F, "execs_per_sec     : %.2f\n", CurrentRate);
+    fprintf(F, "avg_execs_per_sec : %.2f\n", TotalRate);
+    fprintf(F, "corpus_count      : %zu\n", Sample.CorpusSize);
+    fprintf(F, "covered_slots     : %d\n", Sample.CoveredSlots);
+    fprintf(F, "unique_crashes    : %d\n", Sample.UniqueCrashes);
+    fprintf(F, "total_crashes     : %ld\n", Sample.Crashes);
+    fprintf(F, "hangs             : %d\n", Sample.Hangs);
+    fprintf(F, "exec_timeout_ms   : %d\n", Sample.ExecTimeoutMs);
+    fprintf(F, "last_path_s_ago   : %ld\n", secondsSince(LastPath, NowMs));
+    fprintf(F, "last_crash_s_ago  : %ld\n", secondsSince(LastCrash, NowMs));
+    fprintf(F, "last_hang_s_ago   : %ld\n", secondsSince(LastHang, NowMs));
+    for (size_t i = 0; i < Names.size(); ++i)
+      fprintf(F, "mutator_%s : %ld %ld %ld\n", Names[i].c_str(),
+              Mutators[i].Runs.load(), Mutators[i].Finds.load(),
+              Mutators[i].Crashes.load());
+    fclose(F);
+    rename(TmpPath.c_str(), Path.c_str());
+  }
+
+  F = Plot ? fopen((OutDir + "/plot_data").c_str(), "a") : nullptr;
+  if (F) {
+    fprintf(F, "%ld, %.1f, %ld, %.2f, %zu, %d, %d, %ld, %d\n",
+            (long)time(nullptr), Elapsed, Total, CurrentRate,
+            Sample.CorpusSize, Sample.CoveredSlots, Sample.UniqueCrashes,
+            Sample.Crashes, Sample.Hangs);
+    fclose(F);
+  }
+
+  fprintf(stderr,
+          "\e[A\rTried %ld inputs (%.0f/s), %ld crashes found (%d unique), "
+          "%d hangs, %zu queued\n",
+          Total, CurrentRate, Sample.Crashes, Sample.UniqueCrashes,
+          Sample.Hangs, Sample.CorpusSize);
+}
@@ -1,14 +1,61 @@
 #include <Utils.h>
 
-int successCount = 0;
-int failureCount = 0;
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Executor.h"
+#include "Output.h"
+
+std::atomic<int> successCount(0);
+std::atomic<int> failureCount(0);
+std::atomic<int> hangCount(0);
 
 void initialize(std::string &OutDir) {
   int Status;
   std::string SuccessDir = OutDir + "/success";
   std::string FailureDir = OutDir + "/failure";
+  std::string HangDir = OutDir + "/hangs";
   mkdir(SuccessDir.c_str(), 0755);
   mkdir(FailureDir.c_str(), 0755);
+  mkdir(HangDir.c_str(), 0755);
+}
+
+/**
+ * @brief One past the highest N of the inputN files in Dir or in its pack
+ * (see Output.h).
+ */
+static int nextInputIndex(const std::string &Dir) {
+  int Next = 0;
+  int Index;
+  DIR *Directory = opendir(Dir.c_str());
+  if (Directory) {
+    struct dirent *Ent;
+    while ((Ent = readdir(Directory)) != NULL)
+      if (sscanf(Ent->d_name, "input%d", &Index) == 1)
+        Next = std::max(Next, Index + 1);
+    closedir(Directory);
+  }
+  std::ifstream PackIndex(Dir + ".pack.idx");
+  std::string Line;
+  while (std::getline(PackIndex, Line))
+    if (sscanf(Line.c_str(), "input%d", &Index) == 1)
+      Next = std::max(Next, Index + 1);
+  return Next;
+}
+
+void resumeCounts(std::string &OutDir) {
+  successCount = nextInputIndex(OutDir + "/success");
+  failureCount = nextInputIndex(OutDir + "/failure");
+  hangCount = nextInputIndex(OutDir + "/hangs");
 }
 
 std::string readOneFile(std::string &Path) {
@@ -37,6 +84,40 @@ int readSeedInputs(std::vector<std::string> &SeedInputs,
   }
 }
 
+int readDictionary(std::vector<std::string> &Tokens, std::string &Path) {
+  std::ifstream InFile(Path);
+  if (!InFile)
+    return 1;
+  std::string Line;
+  for (int LineNo = 1; std::getline(InFile, Line); ++LineNo) {
+    size_t Start = Line.find('"');
+    size_t End = Line.rfind('"');
+    if (Line.empty() || Line[0] == '#' || Start == End)
+      continue;
+    std::string Token;
+    bool Bad = false;
+    for (size_t i = Start + 1; i < End && !Bad; ++i) {
+      if (Line[i] != '\\' || i + 1 == End) {
+        Token += Line[i];
+      } else if (Line[i + 1] == 'x') {
+        Bad = i + 3 >= End || !isxdigit((unsigned char)Line[i + 2]) ||
+              !isxdigit((unsigned char)Line[i + 3]);
+        if (!Bad)
+          Token += (char)strtol(Line.substr(i + 2, 2).c_str(), nullptr, 16);
+        i += 3;
+      } else {
+        Token += Line[++i];
+      }
+    }
+    if (Bad)
+      fprintf(stderr, "%s:%d: bad \\x escape, skipping the entry\n",
+              Path.c_str(), LineNo);
+    else if (!Token.empty())
+      Tokens.push_back(Token);
+  }
+  return 0;
+}
+
 void readCoverageFile(std::string &Target,
                       std::vector<std::string> &CoverageData) {
   std::string CoveragePath = Target + ".cov";
@@ -56,21 +137,104 @@ void storeSeed(std::string &OutDir, int randomSeed) {
 
 void storePassingInput(std::string &Input, std::string &OutDir) {
   std::string Path = OutDir + "/success/input" + std::to_string(successCount++);
-  std::ofstream OutFile(Path);
-  OutFile << Input;
-  OutFile.close();
+  Output.write(Path, Input);
+}
+
+void storeHangingInput(std::string &Input, std::string &OutDir) {
+  std::string Path = OutDir + "/hangs/input" + std::to_string(hangCount++);
+  Output.write(Path, Input);
 }
 
 void storeCrashingInput(std::string &Input, std::string &OutDir) {
   std::string Path = OutDir + "/failure/input" + std::to_string(failureCount++);
-  std::ofstream OutFile(Path);
-  OutFile << Input;
-  OutFile.close();
+  Output.write(Path, Input);
+}
+
+/**
+ * @brief Milliseconds left until Deadline, at least 0.
+ */
+static int msUntil(std::chrono::steady_clock::time_point Deadline) {
+  auto Left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      Deadline - std::chrono::steady_clock::now());
+  return std::max<long>(0, Left.count());
 }
 
-int runTarget(std::string &Target, std::string &Input) {
-  std::string Cmd = Target + " > /dev/null 2>&1";
-  FILE *F = popen(Cmd.c_str(), "w");
-  fprintf(F, "%s", Input.c_str());
-  return pclose(F);
-}
\ No newline at end of file
+int runTarget(std::string &Target, std::string &Input, int TimeoutMs,
+              size_t MemLimitMb) {
+  // The child inherits the write end of DeathPipe, so the read end reports
+  // a hangup once it has exited, which poll() can wait for with a timeout.
+  int InPipe[2], DeathPipe[2];
+  if (pipe(InPipe) || pipe(DeathPipe)) {
+    perror("pipe");
+    exit(1);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  pid_t Pid = fork();
+  if (Pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (Pid == 0) {
+    int DevNull = open("/dev/null", O_RDWR);
+    dup2(InPipe[0], 0);
+    dup2(DevNull, 1);
+    dup2(DevNull, 2);
+    close(DevNull);
+    close(InPipe[0]);
+    close(InPipe[1]);
+    close(DeathPipe[0]);
+    setMemoryLimit(MemLimitMb);
+    execl(Target.c_str(), Target.c_str(), (char *)NULL);
+    _exit(127);
+  }
+  close(InPipe[0]);
+  close(DeathPipe[1]);
+  fcntl(InPipe[1], F_SETFL, O_NONBLOCK);
+
+  auto Deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(TimeoutMs);
+  size_t Written = 0;
+  bool TimedOut = false;
+  while (true) {
+    // Close stdin once all of Input is written, right away if it is empty,
+    // so the child sees EOF instead of waiting for more.
+    if (InPipe[1] >= 0 && Written == Input.size()) {
+      close(InPipe[1]);
+      InPipe[1] = -1;
+    }
+    struct pollfd Pfds[2] = {{DeathPipe[0], POLLIN, 0},
+                             {InPipe[1], POLLOUT, 0}};
+    int NumFds = InPipe[1] >= 0 ? 2 : 1;
+    int Ready = poll(Pfds, NumFds, TimeoutMs > 0 ? msUntil(Deadline) : -1);
+    if (Ready < 0 && errno == EINTR)
+      continue;
+    if (Ready == 0) {
+      TimedOut = true;
+      break;
+    }
+    if (Pfds[0].revents)
+      break;
+    if (NumFds == 2 && Pfds[1].revents) {
+      ssize_t N = write(InPipe[1], Input.data() + Written,
+                        Input.size() - Written);
+      if (N > 0)
+        Written += N;
+      // Stop feeding a child that closed its stdin.
+      if (N < 0 && errno != EAGAIN)
+        Written = Input.size();
+    }
+  }
+  if (InPipe[1] >= 0)
+    close(InPipe[1]);
+  close(DeathPipe[0]);
+
+  if (TimedOut)
+    kill(Pid, SIGKILL);
+  int Status;
+  while (waitpid(Pid, &Status, 0) < 0 && errno == EINTR)
+    ;
+  if (TimedOut)
+    return EXEC_TIMEOUT;
+  return Status;
+}
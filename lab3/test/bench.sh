@@ -0,0 +1,151 @@
+#!/bin/sh
+
+USAGE="Usage: ./bench.sh [output dir]
+
+Fuzz a fixed set of programs with fixed seeds and collect the results as
+CSV and JSON, to compare fuzzer changes on the same workload:
+  lab3/test/easy*.c, lab3/test/path*.c
+  lab4/test/test*.c, lab5/test/test6.c
+
+Every program is instrumented with this lab's passes and fuzzed with the
+seeds in its lab's fuzz_input/, BENCH_RUNS times with random seeds
+seed, seed+1, ... (seed from ../config.txt).
+
+Environment:
+  BENCH_TIME     time budget per run (default 30s).
+  BENCH_EXECS    exec budget per run (--max-execs), unlimited by default;
+                 BENCH_TIME still applies.
+  BENCH_RUNS     runs per program (default 1).
+  BENCH_TARGETS  space-separated programs to run, by name (e.g. \"easy1
+                 lab4_test2\"), all by default.
+  FUZZER_FLAGS   extra fuzzer options (e.g. -f -s).
+
+Results in [output dir] (default bench_results):
+  summary.csv   one row per run: elapsed seconds, execs, execs/sec,
+                covered slots, queue size, unique crashes and the time to
+                the first one (-1 if none).
+  crashes.csv   the time and exec count of every unique crash found.
+  coverage.csv  the fuzzer's plot_data rows: coverage over time.
+  summary.json  all of the above, one object per run.
+  runs/         the fuzzer output directory of every run."
+
+[ "$1" = "-h" ] && echo "$USAGE" && exit 0
+
+BENCH_OUT="${1:-bench_results}"
+BENCH_TIME="${BENCH_TIME:-30s}"
+BENCH_RUNS="${BENCH_RUNS:-1}"
+FREQ="$(grep 'freq' ../config.txt | cut -d' ' -f2)"
+SEED="$(grep 'seed' ../config.txt | cut -d' ' -f2)"
+BUILD=../build
+BIN_DIR="$BENCH_OUT/bin"
+
+[ ! -x "$BUILD/fuzzer" ] && echo "$BUILD/fuzzer not found" && exit 1
+
+# name:source:seed dir
+PROGRAMS=""
+for SRC in easy*.c path*.c; do
+  PROGRAMS="$PROGRAMS $(basename "$SRC" .c):$SRC:fuzz_input"
+done
+for SRC in ../../lab4/test/test*.c; do
+  PROGRAMS="$PROGRAMS lab4_$(basename "$SRC" .c):$SRC:../../lab4/test/fuzz_input"
+done
+PROGRAMS="$PROGRAMS lab5_test6:../../lab5/test/test6.c:../../lab5/test/fuzz_input"
+
+selected() {
+  [ -z "$BENCH_TARGETS" ] && return 0
+  for T in $BENCH_TARGETS; do
+    [ "$T" = "$1" ] && return 0
+  done
+  return 1
+}
+
+build() {
+  clang -emit-llvm -S -fno-discard-value-names -c -o "$BIN_DIR/$1.ll" "$2" -g &&
+  opt -load "$BUILD/DictionaryPass.so" -load "$BUILD/InstrumentPass.so" \
+      -Dictionary -dict-file="$BIN_DIR/$1.dict" -Instrument ${INSTRUMENT_FLAGS} \
+      -S "$BIN_DIR/$1.ll" -o "$BIN_DIR/$1.instrumented.ll" &&
+  clang -o "$BIN_DIR/$1" -L"$PWD/$BUILD" -lruntime -lm \
+      "$BIN_DIR/$1.instrumented.ll" -g
+}
+
+rm -rf "$BENCH_OUT"
+mkdir -p "$BIN_DIR" "$BENCH_OUT/runs"
+BIN_DIR="$(cd "$BIN_DIR" && pwd)"
+
+SUMMARY="$BENCH_OUT/summary.csv"
+CRASHES="$BENCH_OUT/crashes.csv"
+COVERAGE="$BENCH_OUT/coverage.csv"
+JSON="$BENCH_OUT/summary.json"
+echo "target,run,seed,elapsed_s,execs,execs_per_sec,covered_slots,corpus,unique_crashes,first_crash_s" > "$SUMMARY"
+echo "target,run,crash,elapsed_s,execs" > "$CRASHES"
+echo "target,run,elapsed_s,execs,execs_per_sec,corpus,covered_slots,unique_crashes,crashes,hangs" > "$COVERAGE"
+echo "[" > "$JSON"
+
+FIRST=1
+for PROGRAM in $PROGRAMS; do
+  NAME="${PROGRAM%%:*}"
+  REST="${PROGRAM#*:}"
+  SRC="${REST%%:*}"
+  SEEDS="${REST#*:}"
+  selected "$NAME" || continue
+  if ! build "$NAME" "$SRC" > "$BIN_DIR/$NAME.log" 2>&1; then
+    echo "$NAME: build failed, see $BIN_DIR/$NAME.log"
+    continue
+  fi
+
+  RUN=0
+  while [ "$RUN" -lt "$BENCH_RUNS" ]; do
+    RUN_SEED=$((SEED + RUN))
+    OUT_DIR="$BENCH_OUT/runs/${NAME}_$RUN"
+    mkdir -p "$OUT_DIR"
+    echo "$NAME run $RUN (seed $RUN_SEED)"
+    # A stopped fuzzer finishes its current pick; kill it if that hangs.
+    timeout -k 10s "$BENCH_TIME" "$BUILD/fuzzer" $FUZZER_FLAGS \
+        ${BENCH_EXECS:+--max-execs "$BENCH_EXECS"} "$BIN_DIR/$NAME" \
+        "$SEEDS" "$OUT_DIR" "$FREQ" "$RUN_SEED" > "$OUT_DIR/out.txt" 2>&1
+
+    awk -v T="$NAME" -v R="$RUN" '!/^#/ { sub(/^[0-9]+, /, ""); gsub(/ /, "");
+        print T "," R "," $0 }' "$OUT_DIR/plot_data" >> "$COVERAGE"
+    awk -v T="$NAME" -v R="$RUN" '!/^#/ { gsub(/ /, ""); split($0, F, ",");
+        printf "%s,%s,%s,%.3f,%s\n", T, R, F[3], F[1] / 1000, F[2] }' \
+        "$OUT_DIR/crash_times" >> "$CRASHES"
+
+    [ "$FIRST" = 1 ] || echo "," >> "$JSON"
+    FIRST=0
+    awk -v T="$NAME" -v R="$RUN" -v S="$RUN_SEED" -v SUMMARY="$SUMMARY" '
+      FNR == 1 { File++ }
+      /^#/ { next }
+      { gsub(/ /, ""); split($0, F, ",") }
+      File == 1 {
+        Crash[++Crashes] = sprintf("%.3f", F[1] / 1000)
+        CrashExecs[Crashes] = F[2]
+      }
+      File == 2 {
+        Elapsed = F[2]; Execs = F[3]; Slots = F[6]; Corpus = F[5]
+        Points[++Rows] = sprintf("[%s, %s, %s]", F[2], F[3], F[6])
+      }
+      END {
+        Rate = Elapsed > 0 ? Execs / Elapsed : 0
+        First = Crashes ? Crash[1] : -1
+        printf "%s,%s,%s,%s,%s,%.2f,%s,%s,%d,%s\n", T, R, S, Elapsed, Execs,
+               Rate, Slots, Corpus, Crashes, First >> SUMMARY
+        printf "  {\"target\": \"%s\", \"run\": %s, \"seed\": %s, ", T, R, S
+        printf "\"elapsed_s\": %s, \"execs\": %s, \"execs_per_sec\": %.2f, ",
+               Elapsed + 0, Execs + 0, Rate
+        printf "\"covered_slots\": %d, \"corpus\": %d, ", Slots, Corpus
+        printf "\"unique_crashes\": %d, \"first_crash_s\": %s,\n", Crashes, First
+        printf "   \"crashes\": ["
+        for (i = 1; i <= Crashes; ++i)
+          printf "%s{\"elapsed_s\": %s, \"execs\": %s}", (i > 1 ? ", " : ""),
+                 Crash[i], CrashExecs[i]
+        printf "],\n   \"coverage\": ["
+        for (i = 1; i <= Rows; ++i)
+          printf "%s%s", (i > 1 ? ", " : ""), Points[i]
+        printf "]}"
+      }' "$OUT_DIR/crash_times" "$OUT_DIR/plot_data" >> "$JSON"
+    RUN=$((RUN + 1))
+  done
+done
+
+printf "\n]\n" >> "$JSON"
+column -s, -t "$SUMMARY" 2> /dev/null || cat "$SUMMARY"
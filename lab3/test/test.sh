@@ -1,6 +1,8 @@
 #!/bin/sh
 
-USAGE="Usage: ./test [target] [timeout] [fuzz seed dir]"
+USAGE="Usage: ./test [target] [timeout] [fuzz seed dir]
+
+Extra fuzzer options (e.g. -f) can be passed through FUZZER_FLAGS."
 
 [ -z "$1" ] && echo "$USAGE" && exit 1
 TARGET="./$1"
@@ -16,4 +18,4 @@ rm -rf "$OUT_DIR" "out_$1.txt"
 mkdir -p "$OUT_DIR"
 
 
-timeout "$TIME" ../build/fuzzer "$TARGET" "$FUZZ_SEED" "$OUT_DIR" "$FREQ" "$SEED" > "out_$1.txt" || :
+timeout "$TIME" ../build/fuzzer $FUZZER_FLAGS "$TARGET" "$FUZZ_SEED" "$OUT_DIR" "$FREQ" "$SEED" > "out_$1.txt" || :